@@ -3,62 +3,786 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <iconv.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#if !defined(MTMT_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+#ifdef _WIN32
+// GBK对照表只用到这一个系统函数，直接声明，不引入windows.h（其中的MAX_PATH、near等宏与本文件冲突）
+__declspec(dllimport) int __stdcall MultiByteToWideChar(unsigned int code_page, unsigned long flags,
+                                                        const char* text, int length, wchar_t* wide, int wide_length);
+#define MB_ERR_INVALID_CHARS 0x08
+#endif
 
-#define MAX_LINE_LENGTH 512
-#define MAX_TITLE_LENGTH 256
-#define MAX_HEADINGS 1000
 #define MAX_LEVEL 6
 #define MAX_FILENAME 512
 #define MAX_PATH 1024
+#define READ_CHUNK_SIZE (64 * 1024)
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN 8
+#define HEADING_INDEX_INITIAL 1024
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+#define PATH_LIST_INITIAL 256
+#define BENCH_DEFAULT_SIBLINGS 1000000
+#define BENCH_DEFAULT_HEADINGS 1000000
+#define BENCH_ROUNDS 5
+#define BENCH_DEFAULT_MEGABYTES 50
+#define BENCH_DEFAULT_SECTIONS 200000
+#define CORPUS_MAX_LINE 4096
+#define FENCE_LINES_INITIAL 64
+#define PARALLEL_CHUNK_MIN (4 * 1024 * 1024)
+#define DAEMON_REQUEST_MAX (MAX_PATH + 64)
+#define DAEMON_MMAP_MIN (1024 * 1024)
+#define DAEMON_BACKLOG 64
+#define DAEMON_IDLE_TIMEOUT 60
+#define DAEMON_SEND_TIMEOUT 10
+#define WATCH_DEBOUNCE_MS 200
+#define WATCH_MAX_DELAY_MS 2000
+#define WATCH_EVENT_BUFFER (64 * 1024)
+#define CACHE_MANIFEST "manifest.txt"
+#define CACHE_VERSION 5
+#define RENDER_VERSION 4
+#define BINARY_MAGIC "MTMB"
+#define BINARY_VERSION 1
+#define BINARY_BYTE_ORDER 0x01020304u
+#define SEARCH_INDEX_MAGIC "MTIX"
+#define SEARCH_INDEX_VERSION 1
+#define TRIGRAM_SPACE (1u << 24)
+#define TRIGRAM_SORT_SMALL 64
+#define QUERY_DEFAULT_LIMIT 100
+#define CACHE_TABLE_INITIAL 1024
+#define TITLE_SLICES_INITIAL 32
+#define TITLE_MAX_NESTING 16
+#define GBK_TRAIL_COUNT 191
+#define GBK_TABLE_SIZE (126 * GBK_TRAIL_COUNT)
 
 // 标题节点结构
 typedef struct HeadingNode {
     int level;
-    char text[MAX_TITLE_LENGTH];
+    char* text;
     int line_number;
     struct HeadingNode* parent;
     struct HeadingNode* first_child;
+    struct HeadingNode* last_child;
     struct HeadingNode* next_sibling;
 } HeadingNode;
 
-// 日志条目结构
+// 标题索引 - 按文档顺序保存已加入树的节点，容量不足时翻倍扩展
+typedef struct HeadingIndex {
+    HeadingNode** items;
+    int count;
+    int capacity;
+} HeadingIndex;
+
+// 扁平思维导图 - 按先序（即文档顺序）存放的结构数组，标题文本集中在一个字符串池中
+// 每个标题占用约13字节加标题文本，遍历时顺序访问内存
+typedef struct FlatMindMap {
+    int count;
+    int capacity;
+    uint8_t* levels;
+    int* line_numbers;
+    uint32_t* title_offsets;
+    int* subtree_ends;
+    char* title_pool;
+    size_t pool_size;
+    size_t pool_capacity;
+} FlatMindMap;
+
+// 标题文本片段 - 指向原始缓冲区
+typedef struct TitleSlice {
+    const char* text;
+    size_t length;
+} TitleSlice;
+
+// 标题显示文本 - 去掉行内标记后剩下的片段，按顺序拼接即为显示文本，length为总长度
+// 下标小于pinned的片段可能被分隔符栈引用，不再与后续片段合并
+// 片段数组由解析上下文或融合渲染器持有，在标题之间复用，容量不足时扩展
+typedef struct TitleText {
+    TitleSlice* slices;
+    int capacity;
+    int count;
+    int pinned;
+    size_t length;
+} TitleText;
+
+// 统计阶段 - PHASE_OTHER是最外层的计时，内层阶段之外的时间（打开文件、写文件头等）都记在它上面
+typedef enum StatsPhase {
+    PHASE_READ,
+    PHASE_DECODE,
+    PHASE_SCAN,
+    PHASE_BUILD,
+    PHASE_RENDER,
+    PHASE_WRITE,
+    PHASE_OTHER,
+    PHASE_COUNT
+} StatsPhase;
+
+// 转换统计 - 计数器和各阶段耗时（纳秒），阶段可以嵌套，内层阶段的时间从外层阶段中扣除，各阶段之和即total_ns
+// headings按级别统计识别出的标题（含超过提取级别的），nodes为实际创建的树节点或融合渲染的扁平条目
+// enabled为false时只累加计数器、不读时钟；定义MTMT_NO_STATS编译时所有统计点都不生成代码
+typedef struct ConversionStats {
+    bool enabled;
+    int phase;
+    uint64_t bytes_read;
+    uint64_t lines_scanned;
+    uint64_t candidates;
+    uint64_t headings[MAX_LEVEL + 1];
+    uint64_t nodes;
+    uint64_t output_bytes;
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t total_ns;
+} ConversionStats;
+
+// 阶段计时器 - 开始时间和进入该阶段前所在的阶段（-1表示最外层）
+typedef struct StatsTimer {
+    uint64_t start;
+    int outer;
+} StatsTimer;
+
+#ifndef MTMT_NO_STATS
+#define STATS_ADD(stats, field, n) ((stats)->field += (uint64_t)(n))
+#define STATS_BEGIN(stats, timer, phase) StatsTimer timer = stats_begin((stats), (phase))
+#define STATS_END(stats, timer) ((stats)->enabled ? stats_end((stats), &(timer)) : (void)0)
+#else
+#define STATS_ADD(stats, field, n) ((void)0)
+#define STATS_BEGIN(stats, timer, phase) ((void)0)
+#define STATS_END(stats, timer) ((void)0)
+#endif
+
+// 输出缓冲区 - 渲染结果先写入内存，写满后整块fwrite到file；mirror不为NULL时同时写一份到mirror
+// file为NULL时只在内存中累积，容量按需增长；stats不为NULL时统计写出的字节数和耗时
+typedef struct OutputBuffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+    FILE* file;
+    FILE* mirror;
+    ConversionStats* stats;
+} OutputBuffer;
+
+// 输出格式 - 文本为带文件头的树形图，二进制为可直接映射使用的扁平节点表，JSON和OPML供网页思维导图查看器使用
+typedef enum OutputFormat {
+    FORMAT_TEXT,
+    FORMAT_BINARY,
+    FORMAT_JSON,
+    FORMAT_OPML
+} OutputFormat;
+
+// 输入编码 - ENCODING_AUTO按BOM、UTF-8合法性和GBK双字节结构自动判断
+typedef enum TextEncoding {
+    ENCODING_AUTO,
+    ENCODING_UTF8,
+    ENCODING_GBK
+} TextEncoding;
+
+// 文件标识 - 非Windows平台为设备号和inode，Windows平台为完整路径（忽略大小写）的两个哈希
+typedef struct FileKey {
+    uint64_t device;
+    uint64_t inode;
+} FileKey;
+
+// 路径列表 - 批处理时收集待处理的Markdown文件
+// keys是按文件标识去重的开放寻址表（key_slots为0或2的幂），同一文件经不同路径或参数多次给出时只保留第一次
+typedef struct PathList {
+    char** items;
+    int count;
+    int capacity;
+    FileKey* keys;
+    int key_slots;
+} PathList;
+
+// 缓存清单条目 - 记录上次转换时输入文件的大小、修改时间、内容哈希、提取级别、输出格式和指定的输入编码
+// 修改时间包括纳秒部分，另记inode和状态改变时间；checked为读取文件前的时间（秒），判断当时的修改时间是否可能被同一秒内的写入重复
+typedef struct CacheEntry {
+    char* path;
+    long long size;
+    long long mtime;
+    long long mtime_nsec;
+    long long ctime;
+    long long inode;
+    long long checked;
+    uint64_t hash;
+    int max_level;
+    int format;
+    int encoding;
+} CacheEntry;
+
+// 思维导图缓存 - 缓存目录中按“内容哈希+级别+格式”保存渲染好的思维导图，清单按路径记录文件状态
+// 清单在批处理开始前读入并为每个待处理文件建好条目，运行期间各线程只修改自己文件的条目
+typedef struct MindMapCache {
+    char directory[MAX_PATH];
+    CacheEntry* entries;
+    int count;
+    int capacity;
+    int* slots;
+    int slot_count;
+} MindMapCache;
+
+// 单个文件的转换结果
+typedef enum ConvertResult {
+    CONVERT_FAILED,
+    CONVERT_PARSED,
+    CONVERT_CACHED,
+    CONVERT_SKIPPED
+} ConvertResult;
+
+// 监视中文件的处理状态 - 处理期间文件再次变化时标记为WATCH_RERUN，处理完后重新入队
+typedef enum WatchState {
+    WATCH_IDLE,
+    WATCH_QUEUED,
+    WATCH_RUNNING,
+    WATCH_RERUN
+} WatchState;
+
+// 监视中的文件 - pending表示文件有变化，正在等待这一批事件结束
+typedef struct WatchFile {
+    WatchState state;
+    bool pending;
+} WatchFile;
+
+// 监视任务 - files只在内存中记录每个文件上次渲染时的大小、修改时间和内容哈希，watched与其条目一一对应
+// 监视线程把一批事件结束后的文件下标放进环形队列queue，工作线程取出后只在内容确实变化时重新渲染
+// directories按inotify监视描述符记录目录路径；directories和pending_list只由监视线程使用，其余由mutex保护
+typedef struct WatchJob {
+    int max_level;
+    OutputFormat format;
+    MindMapCache files;
+    WatchFile* watched;
+    int watched_capacity;
+    int* queue;
+    int queue_head;
+    int queue_count;
+    int queue_capacity;
+    int* pending_list;
+    int pending_count;
+    int pending_capacity;
+    char** directories;
+    int directory_capacity;
+    int inotify_fd;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+} WatchJob;
+
+// 批处理任务 - 工作线程从next_index依次领取文件
+// cache为NULL时不使用缓存；否则cache_entries[i]是第i个文件在缓存清单中的条目下标
+// stats.enabled为true时各工作线程结束时把自己的统计累加到stats
+typedef struct BatchJob {
+    PathList* files;
+    int max_level;
+    OutputFormat format;
+    TextEncoding encoding;
+    int parse_threads;
+    int next_index;
+    int failed;
+    int cached;
+    int skipped;
+    MindMapCache* cache;
+    int* cache_entries;
+    ConversionStats stats;
+    pthread_mutex_t mutex;
+} BatchJob;
+
+// 内存池块结构
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+// 内存池 - 一次解析中的所有节点和标题文本都从这里分配，解析结束后整体释放
+typedef struct Arena {
+    ArenaBlock* head;
+} Arena;
+
+// 输入缓冲区结构 - 整个文件一次性映射或读入内存
+typedef struct InputBuffer {
+    const char* data;
+    size_t size;
+    bool mapped;
+    char* owned;
+} InputBuffer;
+
+// 二进制思维导图文件头，后面依次是line_numbers、title_offsets、subtree_ends（各count个32位整数）、
+// levels（count字节）和标题字符串池（pool_size字节）；字段按自然对齐排列，结构体共24字节无填充
+// 整数按写入机器的字节序存放，byte_order用于读取时识别
+typedef struct BinaryMindMapHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t max_level;
+    uint8_t reserved;
+    uint32_t byte_order;
+    uint32_t count;
+    uint64_t pool_size;
+} BinaryMindMapHeader;
+
+// 映射打开的二进制思维导图 - map中的数组直接指向文件内容，不做任何转换
+// 只读，不能追加节点，也不能用free_flat_mind_map释放
+typedef struct MindMapView {
+    InputBuffer input;
+    FlatMindMap map;
+    int max_level;
+} MindMapView;
+
+// 标题搜索索引文件头，后面依次是path_offsets（file_count个）、key_offsets（key_count个）、key_first（key_count+1个）、
+// heading_files和heading_lines（各heading_count个）、trigrams（trigram_count个）、trigram_first（trigram_count+1个）、
+// postings（posting_count个），均为32位整数，然后是heading_levels（heading_count字节）、路径字符串池和标题字符串池
+// 结构体共48字节无填充，整数按写入机器的字节序存放
+typedef struct SearchIndexHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t max_level;
+    uint8_t reserved;
+    uint32_t byte_order;
+    uint32_t file_count;
+    uint32_t key_count;
+    uint32_t heading_count;
+    uint32_t trigram_count;
+    uint32_t posting_count;
+    uint64_t path_pool_size;
+    uint64_t title_pool_size;
+} SearchIndexHeader;
+
+// 映射打开的标题搜索索引 - 各数组直接指向文件内容
+// 不同的标题文本（key）按忽略ASCII大小写的字典序排列，key k的标题位于heading数组的[key_first[k], key_first[k+1])
+// 三元组按值升序排列，三元组t对应postings的[trigram_first[t], trigram_first[t+1])，是含有它的key编号（升序）
+typedef struct SearchIndexView {
+    InputBuffer input;
+    SearchIndexHeader header;
+    const uint32_t* path_offsets;
+    const uint32_t* key_offsets;
+    const uint32_t* key_first;
+    const uint32_t* heading_files;
+    const int* heading_lines;
+    const uint32_t* trigrams;
+    const uint32_t* trigram_first;
+    const uint32_t* postings;
+    const uint8_t* heading_levels;
+    const char* path_pool;
+    const char* title_pool;
+} SearchIndexView;
+
+// 建索引时的一个标题 - prefix为忽略大小写后标题的前8字节（大端），排序时先比较它
+typedef struct IndexEntry {
+    uint64_t prefix;
+    const char* title;
+    uint32_t file;
+    int line_number;
+    int level;
+} IndexEntry;
+
+// 建索引的共享任务 - 工作线程按文件编号依次领取
+typedef struct IndexJob {
+    const PathList* files;
+    int max_level;
+    TextEncoding encoding;
+    int parse_threads;
+    int next_index;
+    int failed;
+    pthread_mutex_t mutex;
+} IndexJob;
+
+// 建索引的标题段 - 若干文件的标题依次存放在一个扁平思维导图中，files[i]为第i个标题所在文件的编号
+typedef struct IndexSegment {
+    FlatMindMap map;
+    uint32_t* files;
+    int file_capacity;
+} IndexSegment;
+
+// 建索引工作线程 - 解析出的标题按文件追加到自己的最后一个段
+// 扁平思维导图的标题偏移是32位的，字符串池放不下下一个文件的标题时开始新的段
+typedef struct IndexWorker {
+    IndexJob* job;
+    IndexSegment* segments;
+    int segment_count;
+    int segment_capacity;
+} IndexWorker;
+
+// 日志条目结构 - stats为该次转换统计的JSON记录，未开启统计时为NULL
 typedef struct LogEntry {
     char timestamp[64];
     char filename[MAX_PATH];
     char operation[128];
+    char* stats;
     struct LogEntry* next;
 } LogEntry;
 
-// 全局变量
-HeadingNode* headings[MAX_HEADINGS];
-int heading_count = 0;
-HeadingNode* root = NULL;
-LogEntry* log_head = NULL;
-int total_operations = 0;
+// 操作日志 - 交互式会话的操作历史
+typedef struct OperationLog {
+    LogEntry* head;
+    int total_operations;
+} OperationLog;
+
+// 块状态 - 扫描时跟踪围栏代码块和文档开头的front matter，其中以#开头的行（如shell注释、YAML注释）不是标题
+// fence_char为所在代码块的围栏字符（`或~），fence_length为开始围栏的长度；front_matter为所在front matter的分隔字符（-或+）
+// 缩进代码块不需要状态：标题必须从行首开始，缩进的代码行本来就不会匹配
+typedef struct BlockState {
+    char fence_char;
+    char front_matter;
+    int fence_length;
+} BlockState;
+
+// 围栏行 - 进入（fence_char不为0）或离开（fence_char为0）围栏代码块的行
+typedef struct FenceLine {
+    int line_number;
+    int fence_length;
+    char fence_char;
+} FenceLine;
+
+// 增量解析状态 - 保存上一次解析的行数，标题记录（含行号）即上下文中的标题索引
+// stale_nodes统计被替换掉但仍占用内存池的节点数，过多时退回完整解析以回收内存
+// fences按行号记录上次解析时的围栏行，body_line为front matter之后的第一行，用于得到任意一行开始时的块状态
+typedef struct IncrementalState {
+    bool valid;
+    int line_count;
+    int stale_nodes;
+    FenceLine* fences;
+    int fence_count;
+    int fence_capacity;
+    int body_line;
+} IncrementalState;
+
+// 解析上下文 - 保存一次解析的全部状态，没有全局变量
+// 每个线程使用各自的上下文即可并行解析；上下文可反复用于多次解析，内存按需复用
+// threads大于1时，大文件分块由多个线程同时扫描；stats累计经过该上下文的所有转换
+// 从文件读入的输入按encoding统一为UTF-8后再解析
+typedef struct ParserContext {
+    Arena arena;
+    HeadingIndex headings;
+    HeadingNode* root;
+    int max_level;
+    OutputBuffer prefix;
+    IncrementalState incremental;
+    FlatMindMap section;
+    TitleText title;
+    int threads;
+    TextEncoding encoding;
+    ConversionStats stats;
+} ParserContext;
+
+// 候选行记录 - 并行扫描找到的#行和围栏行，直接指向输入缓冲区，行号相对于所在分块
+// 分块开始时的块状态未知，所以分块内只找候选行，合并时再按文档顺序由块状态判断
+typedef struct CandidateLine {
+    const char* line;
+    uint32_t length;
+    int line_number;
+} CandidateLine;
+
+// 分块扫描任务 - [start, end)从行首开始、在行尾结束，lines为分块内的换行符数
+typedef struct ChunkScan {
+    const char* start;
+    const char* end;
+    CandidateLine* records;
+    int count;
+    int capacity;
+    int lines;
+} ChunkScan;
+
+// 融合解析渲染状态 - 不建树，只保留当前顶层子树的标题；下一个同级或更高级标题到来时子树已完整，
+// 此时才能确定每个节点是否为最后一个子节点，渲染后立即清空；peak_count记录同时保留的最多标题数
+// 一个顶层子树的标题超出字符串池上限时置overflow，之后的标题不再加入，转换失败
+typedef struct FusedRenderer {
+    FlatMindMap* section;
+    OutputBuffer* output;
+    int max_level;
+    bool found;
+    bool started;
+    BlockState block;
+    TitleText title;
+    int peak_count;
+    bool overflow;
+    ConversionStats* stats;
+} FusedRenderer;
+
+// 守护进程连接 - request保存连接上已收到但还未处理的字节，closing表示连接已断开或出错，交还后关闭
+// 连接空闲时由分发线程poll，有数据到达时交给一个工作线程处理，处理完再交还分发线程
+// session是编辑请求使用的会话上下文，保存session_path文件上次的解析结果，首次编辑请求时创建
+typedef struct DaemonConnection {
+    int fd;
+    bool closing;
+    double last_active;
+    size_t buffered;
+    char request[DAEMON_REQUEST_MAX];
+    ParserContext* session;
+    char* session_path;
+    struct DaemonConnection* next;
+} DaemonConnection;
+
+// 守护进程共享状态 - 分发线程把就绪的连接放入ready队列，工作线程处理完放入returned链表并写wake_pipe唤醒分发线程
+// idle是分发线程独占的空闲连接列表；stopping通知工作线程退出
+typedef struct DaemonServer {
+    int listen_fd;
+    int wake_pipe[2];
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond;
+    DaemonConnection* ready_head;
+    DaemonConnection* ready_tail;
+    DaemonConnection* returned;
+    DaemonConnection** idle;
+    int idle_count;
+    int idle_capacity;
+    bool stopping;
+} DaemonServer;
+
+// 守护进程工作线程 - 解析上下文、小文件的读入缓冲区和输出缓冲区在请求之间复用
+typedef struct DaemonWorker {
+    DaemonServer* server;
+    ParserContext* ctx;
+    char* input;
+    size_t input_capacity;
+    OutputBuffer output;
+} DaemonWorker;
+
+// 标题层次分布 - 平坦（只有1、2级）、均衡（每次上下浮动）、深（倾向于逐级加深）
+typedef enum CorpusDepth {
+    DEPTH_FLAT,
+    DEPTH_BALANCED,
+    DEPTH_DEEP
+} CorpusDepth;
+
+// 合成文档参数 - 相同参数和种子总是生成相同的文档
+// heading_percent为标题行占比，fence_percent为标题后带围栏代码块的比例，cjk_percent为中文词占比
+typedef struct CorpusOptions {
+    size_t size;
+    int heading_percent;
+    CorpusDepth depth;
+    int line_length;
+    int fence_percent;
+    int cjk_percent;
+    bool gbk;
+    unsigned int seed;
+} CorpusOptions;
 
 // 函数声明
+void* arena_alloc(Arena* arena, size_t size, size_t align);
+char* arena_strndup(Arena* arena, const char* text, size_t length);
+void heading_index_push(HeadingIndex* index, HeadingNode* node);
+void heading_index_free(HeadingIndex* index);
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
 void trim_whitespace(char* str);
-bool is_atx_heading(const char* line, int* level, char* title);
+bool is_atx_heading(const char* line, size_t length, int* level, const char** title, size_t* title_length);
 bool is_setext_heading(const char* current_line, const char* next_line, int* level, char* title);
-HeadingNode* create_node(int level, const char* text, int line_num);
-void add_to_tree(HeadingNode* node, int max_level);
-void print_tree(HeadingNode* node, int depth, bool is_last, const char* prefix, FILE* output);
-void free_tree(HeadingNode* node);
+void title_text_init(TitleText* text);
+void title_text_free(TitleText* text);
+void title_append(TitleText* text, const char* ptr, size_t length, bool pinned);
+void normalize_title(const char* title, size_t length, TitleText* text);
+void copy_title_text(const TitleText* text, char* dest);
+ParserContext* create_parser_context();
+void free_parser_context(ParserContext* ctx);
+HeadingNode* create_node(ParserContext* ctx, int level, const char* text, size_t text_length, int line_num);
+HeadingNode* create_title_node(ParserContext* ctx, int level, const TitleText* title, int line_num);
+void add_to_tree(ParserContext* ctx, HeadingNode* node);
+void output_init(OutputBuffer* output, FILE* file);
+void output_write(OutputBuffer* output, const char* text, size_t length);
+void output_puts(OutputBuffer* output, const char* text);
+void output_emit(OutputBuffer* output, const char* text, size_t length);
+void output_flush(OutputBuffer* output);
+void output_free(OutputBuffer* output);
+uint64_t stats_clock();
+void stats_reset(ConversionStats* stats);
+StatsTimer stats_begin(ConversionStats* stats, int phase);
+void stats_end(ConversionStats* stats, StatsTimer* timer);
+void stats_merge(ConversionStats* total, const ConversionStats* part);
+const char* stats_phase_name(int phase);
+void render_stats_json(const ConversionStats* stats, const char* filename, int max_level, OutputBuffer* output);
+void print_stats(const ConversionStats* stats, FILE* output);
+bool parse_stats_flag(const char* arg);
+void print_tree(HeadingNode* node, int depth, bool is_last, OutputBuffer* prefix, OutputBuffer* output);
+void free_tree(ParserContext* ctx);
 const char* get_icon(int level);
-void parse_markdown_file(FILE* file, int max_level);
-void print_mind_map(int max_level, FILE* output);
+bool load_input(FILE* file, InputBuffer* input);
+void release_input(InputBuffer* input);
+const char* find_non_ascii(const char* ptr, const char* end);
+bool validate_utf8_scalar(const char* ptr, const char* end);
+bool is_valid_utf8(const char* data, size_t size);
+bool is_valid_gbk(const char* data, size_t size);
+TextEncoding detect_encoding(const char* data, size_t size);
+void build_gbk_table();
+const uint32_t* get_gbk_table();
+size_t transcode_gbk(const uint32_t* table, const char* data, size_t size, char* output, bool* paired);
+void decode_input(InputBuffer* input, TextEncoding encoding);
+bool parse_encoding_name(const char* name, TextEncoding* encoding);
+const char* encoding_name(TextEncoding encoding);
+bool is_candidate_line(const BlockState* state, const char* ptr, const char* end);
+const char* find_heading_candidate(const BlockState* state, const char* ptr, const char* end, int* line_number);
+const char* find_hash_line(const char* ptr, const char* end, int* line_number);
+bool scan_block_line(BlockState* state, const char* line, size_t length, int* level, const char** title, size_t* title_length);
+char front_matter_delimiter(const char* line, const char* end);
+const char* find_front_matter_close(char delimiter, const char* ptr, const char* end);
+bool front_matter_pending(const char* data, const char* end);
+const char* begin_block_scan(BlockState* state, const char* ptr, const char* end, int* line_number);
+const char* skip_front_matter(BlockState* state, const char* ptr, const char* end, int* line_number);
+void record_fence_line(IncrementalState* state, int line_number, const BlockState* block);
+BlockState block_state_at(const IncrementalState* state, int line_number);
+void parse_markdown_buffer(ParserContext* ctx, const char* data, size_t size, int max_level);
+void* scan_chunk(void* arg);
+int scan_chunks_parallel(const char* data, size_t size, int threads, ChunkScan** chunks);
+void free_chunk_scans(ChunkScan* chunks, int count);
+void parse_markdown_parallel(ParserContext* ctx, const char* data, size_t size, int max_level);
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed);
+int find_first_heading_at(const ParserContext* ctx, int line_number);
+void truncate_tree(ParserContext* ctx, int keep);
+bool splice_heading_region(ParserContext* ctx, const char* region, const char* end, int first_line, int old_end_line, int new_end_line);
+const char* skip_lines(const char* ptr, const char* end, int count);
+bool parse_markdown_edit(ParserContext* ctx, const char* data, size_t size, int first_line, int old_line_count, int new_line_count);
+bool parse_markdown_file(ParserContext* ctx, FILE* file, int max_level);
+void render_mind_map(ParserContext* ctx, OutputBuffer* output);
+void print_mind_map(ParserContext* ctx, FILE* output);
+int format_int(char* buffer, int value);
+void output_int(OutputBuffer* output, int value);
+void output_json_string(OutputBuffer* output, const char* text);
+void output_xml_attribute(OutputBuffer* output, const char* text);
+void render_mind_map_json(ParserContext* ctx, OutputBuffer* output);
+void render_mind_map_opml(ParserContext* ctx, OutputBuffer* output);
+void flat_mind_map_init(FlatMindMap* map);
+bool flat_mind_map_append(FlatMindMap* map, int level, int line_number, const char* title, size_t title_length);
+bool flat_mind_map_append_title(FlatMindMap* map, int level, int line_number, const TitleText* title);
+void flat_mind_map_finish(FlatMindMap* map);
+bool build_flat_mind_map(const ParserContext* ctx, FlatMindMap* map);
+void render_flat_mind_map(const FlatMindMap* map, int max_level, OutputBuffer* output);
+void render_flat_nodes(const FlatMindMap* map, bool more_follows, OutputBuffer* output);
+void print_flat_mind_map(const FlatMindMap* map, int max_level, FILE* output);
+void free_flat_mind_map(FlatMindMap* map);
+void render_mind_map_binary(const FlatMindMap* map, int max_level, OutputBuffer* output);
+bool open_mind_map_view(const char* filename, MindMapView* view);
+bool verify_mind_map_view(const MindMapView* view);
+void close_mind_map_view(MindMapView* view);
+const char* format_extension(OutputFormat format);
+bool parse_output_format(const char* name, OutputFormat* format);
+void set_output_extension(char* output_filename, OutputFormat format);
+bool render_mind_map_body(ParserContext* ctx, OutputFormat format, OutputBuffer* output);
 void get_user_input(char* filename, int* max_level);
 void generate_output_filename(const char* input_filename, char* output_filename);
 void clear_input_buffer();
 void extract_path_and_name(const char* full_path, char* path, char* name);
-void add_log_entry(const char* filename, const char* operation);
-void show_log_history();
+void add_log_entry(OperationLog* log, const char* filename, const char* operation);
+void attach_log_stats(OperationLog* log, const ConversionStats* stats, const char* filename, int max_level);
+void show_log_history(const OperationLog* log);
 void clear_screen();
-void show_main_menu();
-void process_single_file();
-void free_logs();
+void show_main_menu(const OperationLog* log);
+void process_single_file(ParserContext* ctx, OperationLog* log);
+void write_mind_map_header(FILE* output_file, const char* filename, int max_level);
+void write_mind_map_footer(FILE* output_file);
+void write_mind_map_file(ParserContext* ctx, FILE* output_file, const char* filename);
+void path_list_add(PathList* list, const char* path);
+bool file_key(const char* path, const struct stat* st, FileKey* key);
+bool path_list_add_file(PathList* list, const char* path, const struct stat* st);
+void path_list_free(PathList* list);
+bool has_markdown_extension(const char* name);
+void collect_markdown_files(const char* path, PathList* list);
+int detect_cpu_count();
+bool convert_markdown_file(ParserContext* ctx, const char* filename, int max_level, OutputFormat format);
+long long stat_mtime_nsec(const struct stat* st);
+bool cache_entry_unchanged(const CacheEntry* entry, const struct stat* st);
+void cache_entry_record(CacheEntry* entry, const struct stat* st, long long checked);
+void cache_init(MindMapCache* cache);
+bool cache_open(MindMapCache* cache, const char* directory);
+int cache_find_or_add(MindMapCache* cache, const char* path);
+bool cache_save(const MindMapCache* cache);
+void cache_close(MindMapCache* cache);
+ConvertResult convert_markdown_file_cached(ParserContext* ctx, const char* filename, int max_level, OutputFormat format, const MindMapCache* cache, CacheEntry* entry);
+void* batch_worker(void* arg);
+int run_batch(int argc, char* argv[]);
+void flush_stream_section(FlatMindMap* section, bool more_follows, OutputBuffer* output);
+void fused_renderer_init(FusedRenderer* renderer, FlatMindMap* section, int max_level, OutputBuffer* output, ConversionStats* stats);
+void fused_renderer_add(FusedRenderer* renderer, int level, int line_number, const char* title, size_t title_length);
+void fused_renderer_feed(FusedRenderer* renderer, const char* ptr, const char* end, int* line_number);
+bool fused_renderer_finish(FusedRenderer* renderer);
+bool render_markdown_fused(ParserContext* ctx, const char* data, size_t size, int max_level, OutputBuffer* output);
+bool render_markdown_file_fused(ParserContext* ctx, FILE* file, int max_level, OutputBuffer* output);
+int stream_markdown(FILE* input, FILE* output, int max_level, TextEncoding encoding, ConversionStats* stats);
+int show_binary_mind_map(const char* filename);
+unsigned char fold_ascii(unsigned char c);
+uint64_t folded_prefix(const char* text);
+int compare_folded(const char* a, const char* b);
+int compare_folded_prefix(const char* text, const char* query, size_t length);
+int compare_index_entries(const void* a, const void* b);
+int compare_uint32(const void* a, const void* b);
+int unique_trigrams(const char* text, size_t length, uint32_t* trigrams);
+IndexSegment* index_worker_add_segment(IndexWorker* worker);
+bool index_segment_add_file(IndexSegment* segment, const ParserContext* ctx, uint32_t file);
+void free_index_worker(IndexWorker* worker);
+void* index_worker(void* arg);
+bool write_search_index(const char* path, const IndexWorker* workers, int worker_count, const PathList* files, int max_level, uint64_t* index_size);
+int run_index_build(int argc, char* argv[]);
+bool open_search_index(const char* filename, SearchIndexView* view);
+void close_search_index(SearchIndexView* view);
+const char* search_index_title(const SearchIndexView* view, uint32_t key);
+bool folded_contains(const char* text, const char* query, size_t length);
+int intersect_postings(uint32_t* candidates, int count, const uint32_t* list, uint32_t list_count);
+int search_index_prefix(const SearchIndexView* view, const char* query, size_t length, uint32_t** keys);
+int search_index_substring(const SearchIndexView* view, const char* query, size_t length, uint32_t** keys);
+void render_query_results(const SearchIndexView* view, const uint32_t* keys, int key_count, int limit, OutputBuffer* output, int* total);
+int run_query(int argc, char* argv[]);
+bool write_all(int fd, const char* data, size_t length);
+bool daemon_next_request(DaemonConnection* connection, char* line);
+bool daemon_load(DaemonWorker* worker, const char* path, InputBuffer* input);
+const char* daemon_render(DaemonWorker* worker, DaemonConnection* connection, const char* request);
+bool daemon_respond(int fd, const char* header, size_t header_length, const char* body, size_t body_length);
+void daemon_serve(DaemonWorker* worker, DaemonConnection* connection);
+void daemon_worker_init(DaemonWorker* worker, DaemonServer* server, int parse_threads);
+void daemon_worker_free(DaemonWorker* worker);
+void* daemon_worker(void* arg);
+void daemon_close_connection(DaemonConnection* connection);
+void daemon_park(DaemonServer* server, DaemonConnection* connection);
+void daemon_accept(DaemonServer* server);
+void daemon_dispatch(DaemonServer* server, DaemonWorker* inline_worker);
+int open_daemon_socket(const char* path);
+int run_daemon(int argc, char* argv[]);
+int run_daemon_request(int argc, char* argv[]);
+void watch_mark(WatchJob* job, const char* path);
+void watch_mark_tree(WatchJob* job, const char* path);
+void watch_queue_push(WatchJob* job, int index);
+void watch_flush_pending(WatchJob* job);
+void watch_add_tree(WatchJob* job, const char* path);
+void watch_convert(WatchJob* job, ParserContext* ctx, int index);
+void* watch_worker(void* arg);
+void watch_handle_events(WatchJob* job, const char* buffer, size_t length, char** roots, int root_count);
+int run_watch(int argc, char* argv[]);
+void free_logs(OperationLog* log);
+double now_seconds();
+void run_sibling_benchmark(int count);
+void print_tree_recursive(HeadingNode* node, int depth, bool is_last, OutputBuffer* prefix, OutputBuffer* output);
+char* generate_benchmark_document(int count, size_t* size);
+void run_traversal_benchmark(int count);
+void run_export_benchmark(int count);
+void run_fused_benchmark(int count);
+void run_parallel_benchmark(int count, int threads);
+char* generate_code_heavy_document(int sections, size_t* size, int* headings);
+void run_scanner_benchmark(int sections);
+void run_incremental_benchmark(int megabytes);
+unsigned int corpus_random(unsigned int* state);
+size_t append_corpus_words(const CorpusOptions* options, unsigned int* state, char* buffer, size_t target);
+char* generate_corpus(const CorpusOptions* options, size_t* size, int* headings);
+long peak_rss_kb();
+int run_benchmark_harness(int argc, char* argv[]);
+int run_command_line(int argc, char* argv[]);
 
 // 清屏函数
 void clear_screen() {
@@ -83,6 +807,90 @@ void trim_whitespace(char* str) {
     str[end - start + 1] = '\0';
 }
 
+// 从内存池分配内存，当前块不足时申请新块
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+    ArenaBlock* block = arena->head;
+    
+    if (block != NULL) {
+        size_t offset = (block->used + align - 1) & ~(align - 1);
+        if (offset + size <= block->capacity) {
+            block->used = offset + size;
+            return block->data + offset;
+        }
+    }
+    
+    size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+    if (block == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    block->next = arena->head;
+    block->used = size;
+    block->capacity = capacity;
+    arena->head = block;
+    return block->data;
+}
+
+// 在内存池中保存一段文本，按实际长度分配并以'\0'结尾
+char* arena_strndup(Arena* arena, const char* text, size_t length) {
+    char* copy = (char*)arena_alloc(arena, length + 1, 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// 重置内存池 - 保留一个块供下次解析复用，其余块释放
+void arena_reset(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    if (block == NULL) return;
+    
+    while (block->next != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    block->used = 0;
+    arena->head = block;
+}
+
+// 释放内存池的全部内存
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+// 追加节点到标题索引，均摊O(1)
+void heading_index_push(HeadingIndex* index, HeadingNode* node) {
+    if (index->count == index->capacity) {
+        int capacity = index->capacity > 0 ? index->capacity * 2 : HEADING_INDEX_INITIAL;
+        HeadingNode** items = (HeadingNode**)realloc(index->items, (size_t)capacity * sizeof(HeadingNode*));
+        if (items == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        index->items = items;
+        index->capacity = capacity;
+    }
+    
+    index->items[index->count++] = node;
+}
+
+// 释放标题索引
+void heading_index_free(HeadingIndex* index) {
+    free(index->items);
+    index->items = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
 // 清除输入缓冲区
 void clear_input_buffer() {
     int c;
@@ -90,7 +898,7 @@ void clear_input_buffer() {
 }
 
 // 添加日志条目
-void add_log_entry(const char* filename, const char* operation) {
+void add_log_entry(OperationLog* log, const char* filename, const char* operation) {
     LogEntry* new_entry = (LogEntry*)malloc(sizeof(LogEntry));
     if (new_entry == NULL) {
         return;
@@ -106,33 +914,50 @@ void add_log_entry(const char* filename, const char* operation) {
     
     strncpy(new_entry->operation, operation, 127);
     new_entry->operation[127] = '\0';
+    new_entry->stats = NULL;
+    
+    new_entry->next = log->head;
+    log->head = new_entry;
+    log->total_operations++;
+}
+
+// 把转换统计的JSON记录附加到最近一条日志
+void attach_log_stats(OperationLog* log, const ConversionStats* stats, const char* filename, int max_level) {
+    if (log->head == NULL) return;
     
-    new_entry->next = log_head;
-    log_head = new_entry;
-    total_operations++;
+    OutputBuffer json;
+    output_init(&json, NULL);
+    render_stats_json(stats, filename, max_level, &json);
+    output_write(&json, "", 1);
+    free(log->head->stats);
+    log->head->stats = json.data;
 }
 
 // 显示日志历史
-void show_log_history() {
+void show_log_history(const OperationLog* log) {
     clear_screen();
     printf("==========================================\n");
     printf("               操作日志历史\n");
     printf("==========================================\n\n");
     
-    if (log_head == NULL) {
+    if (log->head == NULL) {
         printf("暂无操作记录\n\n");
         return;
     }
     
-    printf("总操作次数: %d\n\n", total_operations);
+    printf("总操作次数: %d\n\n", log->total_operations);
     
-    LogEntry* current = log_head;
+    LogEntry* current = log->head;
     int count = 1;
     
     while (current != NULL) {
         printf("%d. [%s]\n", count++, current->timestamp);
         printf("   文件: %s\n", current->filename);
-        printf("   操作: %s\n\n", current->operation);
+        printf("   操作: %s\n", current->operation);
+        if (current->stats != NULL) {
+            printf("   统计: %s\n", current->stats);
+        }
+        printf("\n");
         current = current->next;
     }
     
@@ -141,21 +966,21 @@ void show_log_history() {
 }
 
 // 释放日志内存
-void free_logs() {
-    LogEntry* current = log_head;
+void free_logs(OperationLog* log) {
+    LogEntry* current = log->head;
     while (current != NULL) {
         LogEntry* next = current->next;
+        free(current->stats);
         free(current);
         current = next;
     }
-    log_head = NULL;
+    log->head = NULL;
 }
 
 // 从完整路径中提取目录路径和文件名
 void extract_path_and_name(const char* full_path, char* path, char* name) {
-    char drive[_MAX_DRIVE], dir[_MAX_DIR], fname[_MAX_FNAME], ext[_MAX_EXT];
-    
     #ifdef _WIN32
+    char drive[_MAX_DRIVE], dir[_MAX_DIR], fname[_MAX_FNAME], ext[_MAX_EXT];
     _splitpath_s(full_path, drive, _MAX_DRIVE, dir, _MAX_DIR, fname, _MAX_FNAME, ext, _MAX_EXT);
     #else
     // 对于非Windows系统，使用简单的方法
@@ -168,9 +993,9 @@ void extract_path_and_name(const char* full_path, char* path, char* name) {
         strcpy(path, "./");
         strcpy(name, full_path);
     }
-    return;
     #endif
     
+    #ifdef _WIN32
     // 构建路径
     strcpy(path, drive);
     strcat(path, dir);
@@ -178,6 +1003,7 @@ void extract_path_and_name(const char* full_path, char* path, char* name) {
     // 构建文件名
     strcpy(name, fname);
     strcat(name, ext);
+    #endif
 }
 
 // 生成输出文件名
@@ -197,45 +1023,375 @@ void generate_output_filename(const char* input_filename, char* output_filename)
     strcat(output_filename, "_mindmap.txt");
 }
 
-// 检查是否为ATX格式标题 - 严格匹配以#开头且回车符结尾的格式
-bool is_atx_heading(const char* line, int* level, char* title) {
+// 检查是否为ATX格式标题 - 严格匹配以#开头的完整行
+// line/length为不含换行符的行切片，title直接指向原始缓冲区，不做拷贝
+bool is_atx_heading(const char* line, size_t length, int* level, const char** title, size_t* title_length) {
     // 空行检查
-    if (!line || *line == '\0') {
+    if (!line || length == 0) {
         return false;
     }
     
     const char* ptr = line;
+    const char* end = line + length;
     int count = 0;
     
     // 计算行首的#数量
-    while (*ptr == '#') {
+    while (ptr < end && *ptr == '#') {
         count++;
         ptr++;
     }
     
     // 严格匹配：至少1个#，最多6个#，#后必须有空格分隔
-    if (count > 0 && count <= MAX_LEVEL && *ptr == ' ') {
+    if (count > 0 && count <= MAX_LEVEL && ptr < end && *ptr == ' ') {
         *level = count;
         
         // 跳过空格
-        while (*ptr == ' ') ptr++;
+        while (ptr < end && *ptr == ' ') ptr++;
         
-        // 提取标题文本，直到行尾或换行符
-        int i = 0;
-        while (*ptr != '\0' && *ptr != '\n' && *ptr != '\r' && i < MAX_TITLE_LENGTH - 1) {
-            title[i++] = *ptr++;
+        // 提取标题文本，直到行尾或回车符
+        const char* title_end = ptr;
+        while (title_end < end && *title_end != '\r') {
+            title_end++;
         }
-        title[i] = '\0';
         
-        // 检查行尾是否为换行符或回车符（表示完整的行）
-        if (*ptr == '\n' || *ptr == '\r') {
-            return true;
-        }
+        *title = ptr;
+        *title_length = (size_t)(title_end - ptr);
+        return true;
     }
     
     return false;
 }
 
+// 初始化标题显示文本，片段数组在第一次使用时分配
+void title_text_init(TitleText* text) {
+    text->slices = NULL;
+    text->capacity = 0;
+    text->count = 0;
+    text->pinned = 0;
+    text->length = 0;
+}
+
+// 释放标题显示文本的片段数组
+void title_text_free(TitleText* text) {
+    free(text->slices);
+    title_text_init(text);
+}
+
+// 向标题显示文本追加一段 - 与上一段在原始缓冲区中相连且上一段未被分隔符栈引用时直接合并
+// pinned为true时该段会被分隔符栈引用（之后可能被缩短或去掉），不与后续片段合并
+void title_append(TitleText* text, const char* ptr, size_t length, bool pinned) {
+    if (length == 0) return;
+    
+    int last = text->count - 1;
+    if (!pinned && last >= text->pinned && text->slices[last].text + text->slices[last].length == ptr) {
+        text->slices[last].length += length;
+        return;
+    }
+    
+    text->slices[text->count].text = ptr;
+    text->slices[text->count].length = length;
+    text->count++;
+    if (pinned) {
+        text->pinned = text->count;
+    }
+}
+
+// 去掉标题中的行内标记 - 结果是指向title的若干片段，按顺序拼接即为显示文本，不复制、不分配内存
+// 依次处理：结尾的#闭合序列，反斜杠转义，`代码`（内容原样保留），*、_、~~强调（只去掉能配对的分隔符），
+// [文本](链接)、[文本][引用]和![替代文本](图片)（保留文本），<自动链接>（保留地址），HTML标签和注释（整体去掉）
+// 没有任何标记的标题只有一段；每追加一段至少消耗一个字节，片段数不超过length + 1，开始前一次备足容量
+void normalize_title(const char* title, size_t length, TitleText* text) {
+    // 需要特殊处理的字符，其余字符都属于普通文本
+    static const unsigned char markup[256] = {
+        ['\\'] = 1, ['`'] = 1, ['*'] = 1, ['_'] = 1, ['~'] = 1, ['['] = 1, [']'] = 1, ['!'] = 1, ['<'] = 1
+    };
+    
+    text->count = 0;
+    text->pinned = 0;
+    text->length = 0;
+    
+    // 结尾的#闭合序列必须与标题文本之间有空白，整个标题都是#时也是闭合序列
+    const char* end = title + length;
+    while (end > title && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    const char* closing = end;
+    while (closing > title && closing[-1] == '#') closing--;
+    if (closing < end && (closing == title || closing[-1] == ' ' || closing[-1] == '\t')) {
+        end = closing;
+        while (end > title && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    }
+    
+    // 大多数标题没有行内标记，整个标题就是一段
+    const char* ptr = title;
+    while (ptr < end && !markup[(unsigned char)*ptr]) ptr++;
+    size_t needed = ptr == end ? 1 : (size_t)(end - title) + 1;
+    if (needed > (size_t)text->capacity) {
+        size_t capacity = text->capacity > 0 ? (size_t)text->capacity : TITLE_SLICES_INITIAL;
+        while (capacity < needed) capacity *= 2;
+        TitleSlice* slices = (TitleSlice*)realloc(text->slices, capacity * sizeof(TitleSlice));
+        if (slices == NULL || capacity > INT_MAX) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        text->slices = slices;
+        text->capacity = (int)capacity;
+    }
+    if (ptr == end) {
+        if (end > title) {
+            text->slices[0].text = title;
+            text->slices[0].length = (size_t)(end - title);
+            text->count = 1;
+            text->length = (size_t)(end - title);
+        }
+        return;
+    }
+    
+    // 强调分隔符栈和方括号栈，记录对应片段的下标
+    struct { char marker; int slice; } delimiters[TITLE_MAX_NESTING];
+    struct { int slice; int delimiters; } brackets[TITLE_MAX_NESTING];
+    int delimiter_count = 0;
+    int bracket_count = 0;
+    
+    title_append(text, title, (size_t)(ptr - title), false);
+    while (ptr < end) {
+        if (!markup[(unsigned char)*ptr]) {
+            const char* run = ptr + 1;
+            while (run < end && !markup[(unsigned char)*run]) run++;
+            title_append(text, ptr, (size_t)(run - ptr), false);
+            ptr = run;
+            continue;
+        }
+        
+        char c = *ptr;
+        if (c == '\\') {
+            // 转义的ASCII标点按字面输出
+            if (ptr + 1 < end && ispunct((unsigned char)ptr[1])) {
+                title_append(text, ptr + 1, 1, false);
+                ptr += 2;
+            } else {
+                title_append(text, ptr, 1, false);
+                ptr++;
+            }
+        } else if (c == '`') {
+            // 代码：找长度相同的反引号串结束，内容两侧都有空格时各去掉一个
+            size_t ticks = 1;
+            while (ptr + ticks < end && ptr[ticks] == '`') ticks++;
+            const char* content = ptr + ticks;
+            const char* close = content;
+            while (close < end) {
+                while (close < end && *close != '`') close++;
+                size_t run = 0;
+                while (close + run < end && close[run] == '`') run++;
+                if (run == ticks) break;
+                close += run;
+            }
+            if (close >= end) {
+                title_append(text, ptr, ticks, false);
+                ptr += ticks;
+                continue;
+            }
+            
+            const char* content_end = close;
+            if (content_end - content >= 2 && content[0] == ' ' && content_end[-1] == ' ') {
+                const char* blank = content;
+                while (blank < content_end && *blank == ' ') blank++;
+                if (blank < content_end) {
+                    content++;
+                    content_end--;
+                }
+            }
+            title_append(text, content, (size_t)(content_end - content), false);
+            ptr = close + ticks;
+        } else if (c == '*' || c == '_' || c == '~') {
+            size_t run = 1;
+            while (ptr + run < end && ptr[run] == c) run++;
+            if (c == '~' && run != 2) {
+                title_append(text, ptr, run, false);
+                ptr += run;
+                continue;
+            }
+            
+            // 左右侧判断：开始和结尾按空白处理，非ASCII字符按字母处理
+            unsigned char before = ptr > title ? (unsigned char)ptr[-1] : ' ';
+            unsigned char after = ptr + run < end ? (unsigned char)ptr[run] : ' ';
+            bool before_space = before == ' ' || before == '\t';
+            bool after_space = after == ' ' || after == '\t';
+            bool before_punct = before < 0x80 && ispunct(before);
+            bool after_punct = after < 0x80 && ispunct(after);
+            bool left = !after_space && (!after_punct || before_space || before_punct);
+            bool right = !before_space && (!before_punct || after_space || after_punct);
+            bool can_open = c == '_' ? left && (!right || before_punct) : left;
+            bool can_close = c == '_' ? right && (!left || after_punct) : right;
+            
+            // 与最近的同种开始分隔符配对，两侧各去掉配对用掉的分隔符，中间未配对的分隔符按字面保留
+            while (run > 0 && can_close) {
+                int k = delimiter_count - 1;
+                while (k >= 0 && delimiters[k].marker != c) k--;
+                if (k < 0) break;
+                
+                TitleSlice* opener = &text->slices[delimiters[k].slice];
+                size_t used = opener->length < run ? opener->length : run;
+                opener->length -= used;
+                run -= used;
+                ptr += used;
+                delimiter_count = opener->length > 0 ? k + 1 : k;
+            }
+            if (run > 0) {
+                bool pushed = can_open && delimiter_count < TITLE_MAX_NESTING;
+                if (pushed) {
+                    delimiters[delimiter_count].marker = c;
+                    delimiters[delimiter_count].slice = text->count;
+                    delimiter_count++;
+                }
+                title_append(text, ptr, run, pushed);
+                ptr += run;
+            }
+        } else if (c == '[' || (c == '!' && ptr + 1 < end && ptr[1] == '[')) {
+            size_t width = c == '!' ? 2 : 1;
+            bool pushed = bracket_count < TITLE_MAX_NESTING;
+            if (pushed) {
+                brackets[bracket_count].slice = text->count;
+                brackets[bracket_count].delimiters = delimiter_count;
+                bracket_count++;
+            }
+            title_append(text, ptr, width, pushed);
+            ptr += width;
+        } else if (c == ']') {
+            // 后面紧跟(目标)或[引用]时是链接或图片：去掉开始的[或![，跳过]及目标，文本中未配对的分隔符不再参与配对
+            const char* target_end = NULL;
+            if (bracket_count > 0 && ptr + 1 < end && ptr[1] == '(') {
+                int depth = 0;
+                for (const char* scan = ptr + 1; scan < end; scan++) {
+                    if (*scan == '\\' && scan + 1 < end) {
+                        scan++;
+                    } else if (*scan == '(') {
+                        depth++;
+                    } else if (*scan == ')' && --depth == 0) {
+                        target_end = scan + 1;
+                        break;
+                    }
+                }
+            } else if (bracket_count > 0 && ptr + 1 < end && ptr[1] == '[') {
+                const char* close = (const char*)memchr(ptr + 2, ']', (size_t)(end - ptr - 2));
+                if (close != NULL) target_end = close + 1;
+            }
+            
+            if (target_end == NULL) {
+                if (bracket_count > 0) bracket_count--;
+                title_append(text, ptr, 1, false);
+                ptr++;
+                continue;
+            }
+            
+            bracket_count--;
+            text->slices[brackets[bracket_count].slice].length = 0;
+            delimiter_count = brackets[bracket_count].delimiters;
+            ptr = target_end;
+        } else if (c == '<') {
+            // 注释和HTML标签整体去掉，自动链接保留地址，其余情况<按字面输出
+            const char* close = NULL;
+            bool keep = false;
+            if (end - ptr >= 4 && memcmp(ptr, "<!--", 4) == 0) {
+                for (const char* scan = ptr + 4; scan + 3 <= end; scan++) {
+                    if (memcmp(scan, "-->", 3) == 0) {
+                        close = scan + 2;
+                        break;
+                    }
+                }
+            } else {
+                const char* scan = ptr + 1;
+                if (scan < end && *scan == '/') scan++;
+                if (scan < end && isalpha((unsigned char)*scan)) {
+                    const char* name = scan;
+                    while (scan < end && (isalnum((unsigned char)*scan) || *scan == '+' || *scan == '.' || *scan == '-')) scan++;
+                    if (scan < end && *scan == ':' && scan - name >= 2 && ptr[1] != '/') {
+                        // 自动链接：<协议:地址>，地址中不能有空白和<
+                        while (scan < end && *scan != '>' && *scan != '<' && *scan != ' ' && *scan != '\t') scan++;
+                        if (scan < end && *scan == '>') {
+                            close = scan;
+                            keep = true;
+                        }
+                    } else {
+                        // 邮件自动链接：<地址@域名>，地址中不能有空白和<
+                        const char* mail = ptr + 1;
+                        while (mail < end && *mail != '>' && *mail != '<' && *mail != ' ' && *mail != '\t') mail++;
+                        if (mail < end && *mail == '>' && memchr(ptr + 1, '@', (size_t)(mail - ptr - 1)) != NULL) {
+                            close = mail;
+                            keep = true;
+                        }
+                        
+                        // 标签：属性值中的引号内可以有>
+                        char quote = 0;
+                        for (; close == NULL && scan < end; scan++) {
+                            if (quote != 0) {
+                                if (*scan == quote) quote = 0;
+                            } else if (*scan == '"' || *scan == '\'') {
+                                quote = *scan;
+                            } else if (*scan == '>') {
+                                close = scan;
+                            } else if (*scan == '<') {
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            
+            if (close == NULL) {
+                title_append(text, ptr, 1, false);
+                ptr++;
+                continue;
+            }
+            if (keep) {
+                title_append(text, ptr + 1, (size_t)(close - ptr - 1), false);
+            }
+            ptr = close + 1;
+        } else {
+            title_append(text, ptr, 1, false);
+            ptr++;
+        }
+    }
+    
+    // 去掉空片段和首尾空白，计算总长度
+    int count = 0;
+    for (int i = 0; i < text->count; i++) {
+        if (text->slices[i].length > 0) {
+            text->slices[count++] = text->slices[i];
+        }
+    }
+    while (count > 0) {
+        TitleSlice* first = &text->slices[0];
+        while (first->length > 0 && (first->text[0] == ' ' || first->text[0] == '\t')) {
+            first->text++;
+            first->length--;
+        }
+        if (first->length > 0) break;
+        memmove(text->slices, text->slices + 1, (size_t)(count - 1) * sizeof(TitleSlice));
+        count--;
+    }
+    while (count > 0) {
+        TitleSlice* last = &text->slices[count - 1];
+        while (last->length > 0 && (last->text[last->length - 1] == ' ' || last->text[last->length - 1] == '\t')) {
+            last->length--;
+        }
+        if (last->length > 0) break;
+        count--;
+    }
+    
+    text->count = count;
+    for (int i = 0; i < count; i++) {
+        text->length += text->slices[i].length;
+    }
+}
+
+// 把标题显示文本的各段依次复制到dest（至少length + 1字节），末尾加'\0'
+void copy_title_text(const TitleText* text, char* dest) {
+    for (int i = 0; i < text->count; i++) {
+        memcpy(dest, text->slices[i].text, text->slices[i].length);
+        dest += text->slices[i].length;
+    }
+    *dest = '\0';
+}
+
 // 检查是否为Setext格式标题
 bool is_setext_heading(const char* current_line, const char* next_line, int* level, char* title) {
     if (strlen(current_line) == 0 || current_line[0] == '#') {
@@ -262,40 +1418,90 @@ bool is_setext_heading(const char* current_line, const char* next_line, int* lev
     return false;
 }
 
-// 创建新节点
-HeadingNode* create_node(int level, const char* text, int line_num) {
-    HeadingNode* node = (HeadingNode*)malloc(sizeof(HeadingNode));
-    if (node == NULL) {
+// 创建解析上下文
+ParserContext* create_parser_context() {
+    ParserContext* ctx = (ParserContext*)malloc(sizeof(ParserContext));
+    if (ctx == NULL) {
         fprintf(stderr, "内存分配失败\n");
         exit(1);
     }
     
+    ctx->arena.head = NULL;
+    ctx->headings.items = NULL;
+    ctx->headings.count = 0;
+    ctx->headings.capacity = 0;
+    ctx->root = NULL;
+    ctx->max_level = MAX_LEVEL;
+    output_init(&ctx->prefix, NULL);
+    memset(&ctx->incremental, 0, sizeof(IncrementalState));
+    flat_mind_map_init(&ctx->section);
+    title_text_init(&ctx->title);
+    ctx->threads = 1;
+    ctx->encoding = ENCODING_AUTO;
+    ctx->stats.enabled = false;
+    stats_reset(&ctx->stats);
+    return ctx;
+}
+
+// 释放解析上下文及其持有的全部内存
+void free_parser_context(ParserContext* ctx) {
+    if (ctx == NULL) return;
+    
+    arena_free(&ctx->arena);
+    heading_index_free(&ctx->headings);
+    output_free(&ctx->prefix);
+    free(ctx->incremental.fences);
+    free_flat_mind_map(&ctx->section);
+    title_text_free(&ctx->title);
+    free(ctx);
+}
+
+// 创建新节点 - 节点和标题文本都分配在上下文的内存池中，text原样使用
+HeadingNode* create_node(ParserContext* ctx, int level, const char* text, size_t text_length, int line_num) {
+    TitleSlice slice = { text, text_length };
+    TitleText title;
+    title.slices = &slice;
+    title.capacity = 1;
+    title.count = 1;
+    title.pinned = 0;
+    title.length = text_length;
+    return create_title_node(ctx, level, &title, line_num);
+}
+
+// 创建标题节点 - 显示文本的各段依次复制到内存池中，拼成一个字符串
+HeadingNode* create_title_node(ParserContext* ctx, int level, const TitleText* title, int line_num) {
+    HeadingNode* node = (HeadingNode*)arena_alloc(&ctx->arena, sizeof(HeadingNode), ARENA_ALIGN);
+    STATS_ADD(&ctx->stats, nodes, 1);
+    
     node->level = level;
-    strncpy(node->text, text, MAX_TITLE_LENGTH - 1);
-    node->text[MAX_TITLE_LENGTH - 1] = '\0';
+    node->text = (char*)arena_alloc(&ctx->arena, title->length + 1, 1);
+    copy_title_text(title, node->text);
     node->line_number = line_num;
     node->parent = NULL;
     node->first_child = NULL;
+    node->last_child = NULL;
     node->next_sibling = NULL;
     
     return node;
 }
 
 // 将节点添加到树中
-void add_to_tree(HeadingNode* node, int max_level) {
-    if (node->level > max_level) {
-        free(node);
+void add_to_tree(ParserContext* ctx, HeadingNode* node) {
+    if (node->level > ctx->max_level) {
         return;
     }
     
-    if (heading_count == 0) {
+    HeadingNode* root = ctx->root;
+    
+    if (ctx->headings.count == 0) {
         node->parent = root;
         root->first_child = node;
-        headings[heading_count++] = node;
+        root->last_child = node;
+        heading_index_push(&ctx->headings, node);
         return;
     }
     
-    HeadingNode* parent = headings[heading_count - 1];
+    HeadingNode* parent = ctx->headings.items[ctx->headings.count - 1];
     
     while (parent != root && parent->level >= node->level) {
         parent = parent->parent;
@@ -303,50 +1509,277 @@ void add_to_tree(HeadingNode* node, int max_level) {
     
     node->parent = parent;
     
+    // 通过last_child直接追加，避免遍历兄弟链
     if (parent->first_child == NULL) {
         parent->first_child = node;
     } else {
-        HeadingNode* sibling = parent->first_child;
-        while (sibling->next_sibling != NULL) {
-            sibling = sibling->next_sibling;
-        }
-        sibling->next_sibling = node;
+        parent->last_child->next_sibling = node;
     }
+    parent->last_child = node;
     
-    if (heading_count < MAX_HEADINGS) {
-        headings[heading_count++] = node;
-    }
+    heading_index_push(&ctx->headings, node);
 }
 
-// 打印树结构
-void print_tree(HeadingNode* node, int depth, bool is_last, const char* prefix, FILE* output) {
-    if (node == NULL) return;
+// 初始化输出缓冲区
+void output_init(OutputBuffer* output, FILE* file) {
+    output->data = NULL;
+    output->length = 0;
+    output->capacity = 0;
+    output->file = file;
+    output->mirror = NULL;
+    output->stats = NULL;
+}
+
+// 写入输出缓冲区 - 有目标文件时写满即整块落盘，否则扩容
+void output_write(OutputBuffer* output, const char* text, size_t length) {
+    if (length == 0) return;
     
-    char current_prefix[256] = "";
-    if (depth > 0) {
-        strcpy(current_prefix, prefix);
-        strcat(current_prefix, is_last ? "└── " : "├── ");
+    if (output->length + length > output->capacity) {
+        if (output->file != NULL) {
+            output_flush(output);
+            
+            // 超过整个缓冲区的数据直接写出
+            if (length >= OUTPUT_BUFFER_SIZE) {
+                output_emit(output, text, length);
+                return;
+            }
+        }
+        
+        if (output->length + length > output->capacity) {
+            size_t capacity = output->capacity > 0 ? output->capacity : OUTPUT_BUFFER_SIZE;
+            while (capacity < output->length + length) {
+                capacity *= 2;
+            }
+            char* data = (char*)realloc(output->data, capacity);
+            if (data == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            output->data = data;
+            output->capacity = capacity;
+        }
     }
     
-    const char* icon = get_icon(node->level);
+    memcpy(output->data + output->length, text, length);
+    output->length += length;
+}
+
+// 写入以'\0'结尾的字符串
+void output_puts(OutputBuffer* output, const char* text) {
+    output_write(output, text, strlen(text));
+}
+
+// 写出到目标文件（和mirror），计入统计的写出阶段
+void output_emit(OutputBuffer* output, const char* text, size_t length) {
+    if (output->stats != NULL) {
+        STATS_BEGIN(output->stats, timer, PHASE_WRITE);
+        fwrite(text, 1, length, output->file);
+        if (output->mirror != NULL) fwrite(text, 1, length, output->mirror);
+        STATS_ADD(output->stats, output_bytes, length);
+        STATS_END(output->stats, timer);
+        return;
+    }
+    fwrite(text, 1, length, output->file);
+    if (output->mirror != NULL) fwrite(text, 1, length, output->mirror);
+}
+
+// 将缓冲区内容一次性写入目标文件
+void output_flush(OutputBuffer* output) {
+    if (output->file != NULL && output->length > 0) {
+        output_emit(output, output->data, output->length);
+        output->length = 0;
+    }
+}
+
+// 释放输出缓冲区（不会自动flush）
+void output_free(OutputBuffer* output) {
+    free(output->data);
+    output->data = NULL;
+    output->length = 0;
+    output->capacity = 0;
+}
+
+// 获取单调时钟（纳秒），用于阶段统计
+uint64_t stats_clock() {
+    struct timespec ts;
+    #ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+    #else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    #endif
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 清零统计，保留是否开启
+void stats_reset(ConversionStats* stats) {
+    bool enabled = stats->enabled;
+    memset(stats, 0, sizeof(ConversionStats));
+    stats->enabled = enabled;
+    stats->phase = -1;
+}
+
+// 进入一个阶段 - 未开启统计时不读时钟
+StatsTimer stats_begin(ConversionStats* stats, int phase) {
+    StatsTimer timer = { 0, -1 };
+    if (!stats->enabled) return timer;
     
-    if (node->parent == root) {
-        fprintf(output, "%s%s %s\n", current_prefix, icon, node->text);
+    timer.outer = stats->phase;
+    stats->phase = phase;
+    timer.start = stats_clock();
+    return timer;
+}
+
+// 离开阶段 - 耗时记到该阶段并从外层阶段扣除（外层结束时会把整段时间加回去），最外层的耗时计入总时间
+// 由STATS_END在开启统计时调用
+void stats_end(ConversionStats* stats, StatsTimer* timer) {
+    uint64_t elapsed = stats_clock() - timer->start;
+    stats->phase_ns[stats->phase] += elapsed;
+    if (timer->outer >= 0) {
+        stats->phase_ns[timer->outer] -= elapsed;
     } else {
-        fprintf(output, "%s%s %s\n", current_prefix, icon, node->text);
+        stats->total_ns += elapsed;
+    }
+    stats->phase = timer->outer;
+}
+
+// 把一份统计累加到另一份
+void stats_merge(ConversionStats* total, const ConversionStats* part) {
+    total->bytes_read += part->bytes_read;
+    total->lines_scanned += part->lines_scanned;
+    total->candidates += part->candidates;
+    for (int level = 0; level <= MAX_LEVEL; level++) {
+        total->headings[level] += part->headings[level];
+    }
+    total->nodes += part->nodes;
+    total->output_bytes += part->output_bytes;
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        total->phase_ns[phase] += part->phase_ns[phase];
+    }
+    total->total_ns += part->total_ns;
+}
+
+// 获取阶段名称
+const char* stats_phase_name(int phase) {
+    switch (phase) {
+        case PHASE_READ: return "read";
+        case PHASE_DECODE: return "decode";
+        case PHASE_SCAN: return "scan";
+        case PHASE_BUILD: return "build";
+        case PHASE_RENDER: return "render";
+        case PHASE_WRITE: return "write";
+        default: return "other";
+    }
+}
+
+// 渲染统计的JSON记录（单行），filename为NULL时省略file字段
+void render_stats_json(const ConversionStats* stats, const char* filename, int max_level, OutputBuffer* output) {
+    char number[32];
+    
+    output_puts(output, "{");
+    if (filename != NULL) {
+        output_puts(output, "\"file\":");
+        output_json_string(output, filename);
+        output_puts(output, ",");
     }
+    output_puts(output, "\"max_level\":");
+    output_int(output, max_level);
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)stats->bytes_read);
+    output_puts(output, ",\"bytes_read\":");
+    output_puts(output, number);
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)stats->lines_scanned);
+    output_puts(output, ",\"lines_scanned\":");
+    output_puts(output, number);
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)stats->candidates);
+    output_puts(output, ",\"candidates\":");
+    output_puts(output, number);
+    output_puts(output, ",\"headings\":[");
+    for (int level = 1; level <= MAX_LEVEL; level++) {
+        snprintf(number, sizeof(number), level > 1 ? ",%llu" : "%llu", (unsigned long long)stats->headings[level]);
+        output_puts(output, number);
+    }
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)stats->nodes);
+    output_puts(output, "],\"nodes\":");
+    output_puts(output, number);
+    snprintf(number, sizeof(number), "%llu", (unsigned long long)stats->output_bytes);
+    output_puts(output, ",\"output_bytes\":");
+    output_puts(output, number);
+    output_puts(output, ",\"ns\":{");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        snprintf(number, sizeof(number), "%s\"%s\":%llu", phase > 0 ? "," : "", stats_phase_name(phase),
+                 (unsigned long long)stats->phase_ns[phase]);
+        output_puts(output, number);
+    }
+    snprintf(number, sizeof(number), ",\"total\":%llu}}", (unsigned long long)stats->total_ns);
+    output_puts(output, number);
+}
+
+// 打印统计摘要（交互模式）
+void print_stats(const ConversionStats* stats, FILE* output) {
+    fprintf(output, "Statistics:\n");
+    fprintf(output, "  Bytes read: %llu, lines: %llu, candidates: %llu, nodes: %llu, output bytes: %llu\n",
+            (unsigned long long)stats->bytes_read, (unsigned long long)stats->lines_scanned,
+            (unsigned long long)stats->candidates, (unsigned long long)stats->nodes,
+            (unsigned long long)stats->output_bytes);
+    fprintf(output, "  Headings:");
+    for (int level = 1; level <= MAX_LEVEL; level++) {
+        fprintf(output, " H%d %llu", level, (unsigned long long)stats->headings[level]);
+    }
+    fprintf(output, "\n  Time (ms):");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        fprintf(output, " %s %.3f", stats_phase_name(phase), stats->phase_ns[phase] / 1e6);
+    }
+    fprintf(output, ", total %.3f\n", stats->total_ns / 1e6);
+}
+
+// 识别--stats参数，统计被编译掉时报错
+bool parse_stats_flag(const char* arg) {
+    if (strcmp(arg, "--stats") != 0) return false;
+    #ifdef MTMT_NO_STATS
+    fprintf(stderr, "Error: Statistics are not available in this build (compiled with MTMT_NO_STATS)\n");
+    exit(1);
+    #endif
+    return true;
+}
+
+// 打印树结构 - 沿first_child/next_sibling/parent指针迭代遍历，不使用递归
+// prefix作为前缀栈，进入子节点时追加一段，回到父节点时截掉父节点那一段
+void print_tree(HeadingNode* node, int depth, bool is_last, OutputBuffer* prefix, OutputBuffer* output) {
+    if (node == NULL) return;
     
-    char new_prefix[256];
-    strcpy(new_prefix, prefix);
-    strcat(new_prefix, is_last ? "    " : "│   ");
+    size_t prefix_length = prefix->length;
+    HeadingNode* current = node;
+    bool current_last = is_last;
     
-    HeadingNode* child = node->first_child;
-    while (child != NULL) {
-        HeadingNode* next_child = child->next_sibling;
-        bool last_child = (next_child == NULL);
-        print_tree(child, depth + 1, last_child, new_prefix, output);
-        child = next_child;
+    while (1) {
+        output_write(output, prefix->data, prefix->length);
+        if (depth > 0) {
+            output_puts(output, current_last ? "└── " : "├── ");
+        }
+        output_puts(output, get_icon(current->level));
+        output_write(output, " ", 1);
+        output_puts(output, current->text);
+        output_write(output, "\n", 1);
+        
+        if (current->first_child != NULL) {
+            output_puts(prefix, current_last ? "    " : "│   ");
+            current = current->first_child;
+            depth++;
+        } else {
+            // 回溯到还有下一个兄弟的祖先
+            while (current != node && current->next_sibling == NULL) {
+                current = current->parent;
+                depth--;
+                bool parent_last = (current == node) ? is_last : (current->next_sibling == NULL);
+                prefix->length -= strlen(parent_last ? "    " : "│   ");
+            }
+            if (current == node) break;
+            current = current->next_sibling;
+        }
+        
+        current_last = (current->next_sibling == NULL);
     }
+    
+    prefix->length = prefix_length;
 }
 
 // 获取级别对应的图标
@@ -362,218 +1795,6039 @@ const char* get_icon(int level) {
     }
 }
 
-// 释放树内存
-void free_tree(HeadingNode* node) {
-    if (node == NULL) return;
-    
-    HeadingNode* child = node->first_child;
-    while (child != NULL) {
-        HeadingNode* next_child = child->next_sibling;
-        free_tree(child);
-        child = next_child;
-    }
-    
-    if (node != root) {
-        free(node);
-    }
+// 释放树内存 - 所有节点都属于上下文的内存池，整体重置即可，无需逐个遍历
+void free_tree(ParserContext* ctx) {
+    arena_reset(&ctx->arena);
+    ctx->root = NULL;
+    ctx->headings.count = 0;
+    ctx->incremental.valid = false;
+    ctx->incremental.stale_nodes = 0;
 }
 
-// 解析Markdown文件 - 只提取ATX格式标题
-void parse_markdown_file(FILE* file, int max_level) {
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    
-    heading_count = 0;
-    for (int i = 0; i < MAX_HEADINGS; i++) {
-        headings[i] = NULL;
-    }
+// 读入整个输入 - 普通文件使用mmap映射，管道等不可映射的输入退回到分块读取
+bool load_input(FILE* file, InputBuffer* input) {
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = false;
+    input->owned = NULL;
     
-    root = create_node(0, "Document Structure", 0);
+    struct stat st;
+    bool regular = fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode);
     
-    while (fgets(line, sizeof(line), file)) {
-        line_number++;
-        // 不调用trim_whitespace，保持原始行格式以验证回车符结尾
-        
-        int level;
-        char title[MAX_TITLE_LENGTH];
-        
-        // 只处理ATX格式标题，忽略Setext格式
-        if (is_atx_heading(line, &level, title)) {
-            HeadingNode* node = create_node(level, title, line_number);
-            add_to_tree(node, max_level);
+    #ifndef _WIN32
+    if (regular && st.st_size > 0) {
+        void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            input->data = (const char*)map;
+            input->size = (size_t)st.st_size;
+            input->mapped = true;
+            return true;
         }
     }
-}
-
-// 打印思维导图
-void print_mind_map(int max_level, FILE* output) {
-    if (root == NULL || root->first_child == NULL) {
-        fprintf(output, "No headings found at level %d or below\n", max_level);
-        return;
-    }
+    #endif
     
-    fprintf(output, "[D] Document Structure\n");
+    // 分块读取，已知大小时一次分配到位
+    size_t capacity = (regular && st.st_size > 0) ? (size_t)st.st_size + 1 : READ_CHUNK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    if (buffer == NULL) {
+        return false;
+    }
     
-    HeadingNode* child = root->first_child;
-    while (child != NULL) {
-        HeadingNode* next_child = child->next_sibling;
+    size_t size = 0;
+    while (1) {
+        if (capacity - size < READ_CHUNK_SIZE / 2) {
+            char* grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                free(buffer);
+                return false;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        
+        size_t n = fread(buffer + size, 1, capacity - size, file);
+        if (n == 0) break;
+        size += n;
+    }
+    
+    if (ferror(file)) {
+        free(buffer);
+        return false;
+    }
+    
+    input->data = buffer;
+    input->size = size;
+    input->owned = buffer;
+    return true;
+}
+
+// 释放输入缓冲区
+void release_input(InputBuffer* input) {
+    #ifndef _WIN32
+    if (input->mapped) {
+        munmap((void*)input->data, input->size);
+    }
+    #endif
+    free(input->owned);
+    
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = false;
+    input->owned = NULL;
+}
+
+// 查找第一个非ASCII字节（最高位为1），没有时返回end
+const char* find_non_ascii(const char* ptr, const char* end) {
+    #if !defined(MTMT_NO_SIMD) && defined(__AVX2__)
+    // 每次检查32字节，movemask直接取出各字节的最高位
+    while (end - ptr >= 32) {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)ptr));
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 32;
+    }
+    #elif !defined(MTMT_NO_SIMD) && defined(__SSE2__)
+    // 每次检查16字节，movemask直接取出各字节的最高位
+    while (end - ptr >= 16) {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ptr));
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 16;
+    }
+    #endif
+    
+    while (ptr < end && (unsigned char)*ptr < 0x80) {
+        ptr++;
+    }
+    return ptr;
+}
+
+// 逐字符校验UTF-8 - 拒绝截断、多余的后续字节、过长编码、代理项和超出U+10FFFF的码点
+bool validate_utf8_scalar(const char* ptr, const char* end) {
+    while (ptr < end) {
+        if ((unsigned char)*ptr < 0x80) {
+            ptr = find_non_ascii(ptr, end);
+            continue;
+        }
+        
+        const unsigned char* bytes = (const unsigned char*)ptr;
+        int length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (bytes[0] >= 0xC2 && bytes[0] <= 0xDF) {
+            length = 2;
+        } else if (bytes[0] >= 0xE0 && bytes[0] <= 0xEF) {
+            length = 3;
+            if (bytes[0] == 0xE0) low = 0xA0;
+            if (bytes[0] == 0xED) high = 0x9F;
+        } else if (bytes[0] >= 0xF0 && bytes[0] <= 0xF4) {
+            length = 4;
+            if (bytes[0] == 0xF0) low = 0x90;
+            if (bytes[0] == 0xF4) high = 0x8F;
+        } else {
+            return false;
+        }
+        
+        if (end - ptr < length || bytes[1] < low || bytes[1] > high) {
+            return false;
+        }
+        for (int i = 2; i < length; i++) {
+            if ((bytes[i] & 0xC0) != 0x80) return false;
+        }
+        ptr += length;
+    }
+    return true;
+}
+
+// 校验UTF-8
+// AVX2下用查表法（Keiser、Lemire）：以前一字节的高、低半字节和当前字节的高半字节各查一张表，三者按位与得到错误类别，
+// 3、4字节序列的第三、四字节另外与前两、三字节比对；纯ASCII的块只检查上一块末尾是否留有未完成的序列
+bool is_valid_utf8(const char* data, size_t size) {
+    #if !defined(MTMT_NO_SIMD) && defined(__AVX2__)
+    enum {
+        TOO_SHORT = 1 << 0,
+        TOO_LONG = 1 << 1,
+        OVERLONG_3 = 1 << 2,
+        TOO_LARGE = 1 << 3,
+        SURROGATE = 1 << 4,
+        OVERLONG_2 = 1 << 5,
+        TOO_LARGE_1000 = 1 << 6,
+        OVERLONG_4 = 1 << 6,
+        TWO_CONTS = 1 << 7,
+        CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS
+    };
+    static const unsigned char byte_1_high[16] = {
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+    };
+    static const unsigned char byte_1_low[16] = {
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+    };
+    static const unsigned char byte_2_high[16] = {
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+    };
+    // 块末尾三个字节分别不小于0xF0、0xE0、0xC0时序列延续到下一块
+    static const unsigned char incomplete_limit[32] = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+    };
+    
+    const __m256i table_1_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_1_high));
+    const __m256i table_1_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_1_low));
+    const __m256i table_2_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte_2_high));
+    const __m256i limit = _mm256_loadu_si256((const __m256i*)incomplete_limit);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i third_lead = _mm256_set1_epi8((char)(0xE0 - 0x80));
+    const __m256i fourth_lead = _mm256_set1_epi8((char)(0xF0 - 0x80));
+    const __m256i high_bit = _mm256_set1_epi8((char)0x80);
+    
+    __m256i previous = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    
+    const char* ptr = data;
+    const char* end = data + size;
+    char tail[32];
+    while (ptr < end) {
+        // 最后不足32字节时补空格
+        __m256i input;
+        if (end - ptr >= 32) {
+            input = _mm256_loadu_si256((const __m256i*)ptr);
+        } else {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, ptr, (size_t)(end - ptr));
+            input = _mm256_loadu_si256((const __m256i*)tail);
+        }
+        ptr += 32;
+        
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, incomplete);
+        } else {
+            // prev1、prev2、prev3为每个位置之前第1、2、3个字节，跨块部分取自上一块
+            __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+            
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(table_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                    _mm256_shuffle_epi8(table_1_low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(table_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+            __m256i must_continue = _mm256_and_si256(
+                _mm256_or_si256(_mm256_subs_epu8(prev2, third_lead), _mm256_subs_epu8(prev3, fourth_lead)), high_bit);
+            error = _mm256_or_si256(error, _mm256_xor_si256(must_continue, special));
+            incomplete = _mm256_subs_epu8(input, limit);
+        }
+        previous = input;
+        
+        if (!_mm256_testz_si256(error, error)) {
+            return false;
+        }
+    }
+    
+    error = _mm256_or_si256(error, incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+    #elif !defined(MTMT_NO_SIMD) && defined(__SSE2__)
+    // SSE2没有按字节查表的指令，改为逐项比较：后续字节必须恰好出现在2、3、4字节序列的首字节之后，
+    // 不能出现C0、C1和F5-FF，E0、ED、F0、F4之后第二个字节的范围另外比较
+    static const unsigned char incomplete_limit[16] = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+    };
+    const __m128i limit = _mm_loadu_si128((const __m128i*)incomplete_limit);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lead_2 = _mm_set1_epi8((char)0xC0);
+    const __m128i lead_3 = _mm_set1_epi8((char)0xE0);
+    const __m128i lead_4 = _mm_set1_epi8((char)0xF0);
+    const __m128i too_large = _mm_set1_epi8((char)0xF5);
+    const __m128i overlong_2 = _mm_set1_epi8((char)0xFE);
+    
+    __m128i previous = zero;
+    __m128i incomplete = zero;
+    __m128i error = zero;
+    
+    const char* ptr = data;
+    const char* end = data + size;
+    char tail[16];
+    while (ptr < end) {
+        // 最后不足16字节时补空格
+        __m128i input;
+        if (end - ptr >= 16) {
+            input = _mm_loadu_si128((const __m128i*)ptr);
+        } else {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, ptr, (size_t)(end - ptr));
+            input = _mm_loadu_si128((const __m128i*)tail);
+        }
+        ptr += 16;
+        
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, incomplete);
+        } else {
+            // prev1、prev2、prev3为每个位置之前第1、2、3个字节，跨块部分取自上一块
+            __m128i prev1 = _mm_or_si128(_mm_slli_si128(input, 1), _mm_srli_si128(previous, 15));
+            __m128i prev2 = _mm_or_si128(_mm_slli_si128(input, 2), _mm_srli_si128(previous, 14));
+            __m128i prev3 = _mm_or_si128(_mm_slli_si128(input, 3), _mm_srli_si128(previous, 13));
+            
+            // 无符号比较x >= k写成max(x, k) == x；后续字节0x80-0xBF按有符号数恰好小于(char)0xC0
+            __m128i expected = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(prev1, lead_2), prev1),
+                               _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(prev2, lead_3), prev2),
+                                            _mm_cmpeq_epi8(_mm_max_epu8(prev3, lead_4), prev3)));
+            __m128i continuation = _mm_cmplt_epi8(input, lead_2);
+            error = _mm_or_si128(error, _mm_xor_si128(expected, continuation));
+            
+            __m128i forbidden = _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(input, overlong_2), lead_2),
+                                             _mm_cmpeq_epi8(_mm_max_epu8(input, too_large), input));
+            __m128i second = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xE0)), _mm_cmplt_epi8(input, _mm_set1_epi8((char)0xA0))),
+                             _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xED)), _mm_cmpgt_epi8(input, _mm_set1_epi8((char)0x9F)))),
+                _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF0)), _mm_cmplt_epi8(input, _mm_set1_epi8((char)0x90))),
+                             _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF4)), _mm_cmpgt_epi8(input, _mm_set1_epi8((char)0x8F)))));
+            error = _mm_or_si128(error, _mm_or_si128(forbidden, second));
+            incomplete = _mm_subs_epu8(input, limit);
+        }
+        previous = input;
+        
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    
+    error = _mm_or_si128(error, incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) == 0xFFFF;
+    #else
+    return validate_utf8_scalar(data, data + size);
+    #endif
+}
+
+// 判断是否为结构上合法的GBK文本 - 每个0x81-0xFE的首字节后都跟着0x40-0xFE（0x7F除外）的尾字节
+bool is_valid_gbk(const char* data, size_t size) {
+    const char* ptr = data;
+    const char* end = data + size;
+    while (ptr < end) {
+        if ((unsigned char)*ptr < 0x80) {
+            ptr = find_non_ascii(ptr, end);
+            continue;
+        }
+        
+        unsigned char lead = (unsigned char)ptr[0];
+        if (lead < 0x81 || lead > 0xFE || end - ptr < 2) {
+            return false;
+        }
+        unsigned char trail = (unsigned char)ptr[1];
+        if (trail < 0x40 || trail > 0xFE || trail == 0x7F) {
+            return false;
+        }
+        ptr += 2;
+    }
+    return true;
+}
+
+// 检测输入编码 - 有UTF-8 BOM或是合法UTF-8时为UTF-8，否则结构上是合法GBK时为GBK，两者都不是时仍按UTF-8处理
+TextEncoding detect_encoding(const char* data, size_t size) {
+    if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        return ENCODING_UTF8;
+    }
+    if (is_valid_utf8(data, size)) {
+        return ENCODING_UTF8;
+    }
+    return is_valid_gbk(data, size) ? ENCODING_GBK : ENCODING_UTF8;
+}
+
+// GBK转UTF-8查找表 - 首次使用时生成一次，之后只读，所有线程共享
+static uint32_t* gbk_utf8_table = NULL;
+static pthread_once_t gbk_table_once = PTHREAD_ONCE_INIT;
+
+// 生成GBK转UTF-8查找表 - 逐个双字节字符交给系统的编码转换（POSIX为iconv，Windows为代码页936）
+// 每项按内存顺序依次为UTF-8字节，第4字节为长度，整项为0表示该字符没有定义；失败时表保持为NULL
+void build_gbk_table() {
+    uint32_t* table = (uint32_t*)calloc(GBK_TABLE_SIZE, sizeof(uint32_t));
+    if (table == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    #ifdef _WIN32
+    for (int lead = 0x81; lead <= 0xFE; lead++) {
+        for (int trail = 0x40; trail <= 0xFE; trail++) {
+            char bytes[2] = { (char)lead, (char)trail };
+            wchar_t wide;
+            if (trail == 0x7F || MultiByteToWideChar(936, MB_ERR_INVALID_CHARS, bytes, 2, &wide, 1) != 1) continue;
+            
+            unsigned char* entry = (unsigned char*)&table[(lead - 0x81) * GBK_TRAIL_COUNT + (trail - 0x40)];
+            unsigned int code = (unsigned int)wide;
+            if (code < 0x80) {
+                entry[0] = (unsigned char)code;
+                entry[3] = 1;
+            } else if (code < 0x800) {
+                entry[0] = (unsigned char)(0xC0 | (code >> 6));
+                entry[1] = (unsigned char)(0x80 | (code & 0x3F));
+                entry[3] = 2;
+            } else if (code < 0xD800 || code > 0xDFFF) {
+                entry[0] = (unsigned char)(0xE0 | (code >> 12));
+                entry[1] = (unsigned char)(0x80 | ((code >> 6) & 0x3F));
+                entry[2] = (unsigned char)(0x80 | (code & 0x3F));
+                entry[3] = 3;
+            }
+        }
+    }
+    #else
+    iconv_t converter = iconv_open("UTF-8", "GBK");
+    if (converter == (iconv_t)-1) {
+        free(table);
+        return;
+    }
+    for (int lead = 0x81; lead <= 0xFE; lead++) {
+        for (int trail = 0x40; trail <= 0xFE; trail++) {
+            if (trail == 0x7F) continue;
+            
+            char bytes[2] = { (char)lead, (char)trail };
+            char utf8[8];
+            char* in = bytes;
+            char* out = utf8;
+            size_t in_left = sizeof(bytes);
+            size_t out_left = sizeof(utf8);
+            iconv(converter, NULL, NULL, NULL, NULL);
+            if (iconv(converter, &in, &in_left, &out, &out_left) == (size_t)-1 || in_left != 0) continue;
+            
+            size_t length = sizeof(utf8) - out_left;
+            if (length == 0 || length > 3) continue;
+            unsigned char* entry = (unsigned char*)&table[(lead - 0x81) * GBK_TRAIL_COUNT + (trail - 0x40)];
+            memcpy(entry, utf8, length);
+            entry[3] = (unsigned char)length;
+        }
+    }
+    iconv_close(converter);
+    #endif
+    
+    gbk_utf8_table = table;
+}
+
+// 获取GBK转UTF-8查找表，系统不支持GBK转换时返回NULL
+const uint32_t* get_gbk_table() {
+    pthread_once(&gbk_table_once, build_gbk_table);
+    return gbk_utf8_table;
+}
+
+// GBK转UTF-8 - ASCII段按块整体写出，双字节字符查表写出；没有定义的双字节字符写为U+FFFD，不成对的字节写为?
+// 输出最多为输入的1.5倍，output至少要有size + size / 2 + 4字节：按块写出和按4字节写出表项时多写的部分都落在这个余量内
+// 返回写出的长度；paired不为NULL时，出现不成对的字节（即不是结构上合法的GBK）则置为false
+size_t transcode_gbk(const uint32_t* table, const char* data, size_t size, char* output, bool* paired) {
+    const char* ptr = data;
+    const char* end = data + size;
+    char* out = output;
+    while (ptr < end) {
+        #if !defined(MTMT_NO_SIMD) && defined(__AVX2__)
+        // 先写出整块，再只前进块中ASCII前缀的长度
+        while (end - ptr >= 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i*)ptr);
+            _mm256_storeu_si256((__m256i*)out, block);
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(block);
+            if (mask != 0) {
+                ptr += __builtin_ctz(mask);
+                out += __builtin_ctz(mask);
+                break;
+            }
+            ptr += 32;
+            out += 32;
+        }
+        #elif !defined(MTMT_NO_SIMD) && defined(__SSE2__)
+        // 先写出整块，再只前进块中ASCII前缀的长度
+        while (end - ptr >= 16) {
+            __m128i block = _mm_loadu_si128((const __m128i*)ptr);
+            _mm_storeu_si128((__m128i*)out, block);
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(block);
+            if (mask != 0) {
+                ptr += __builtin_ctz(mask);
+                out += __builtin_ctz(mask);
+                break;
+            }
+            ptr += 16;
+            out += 16;
+        }
+        #endif
+        while (ptr < end && (unsigned char)*ptr < 0x80) {
+            *out++ = *ptr++;
+        }
+        
+        // 连续的双字节字符逐个查表，整项写出4字节再按长度前进
+        while (ptr < end && (unsigned char)*ptr >= 0x80) {
+            unsigned char lead = (unsigned char)ptr[0];
+            unsigned char trail = end - ptr >= 2 ? (unsigned char)ptr[1] : 0;
+            if (lead == 0x80 || lead == 0xFF || trail < 0x40 || trail == 0x7F || trail == 0xFF) {
+                if (paired != NULL) *paired = false;
+                *out++ = '?';
+                ptr++;
+                continue;
+            }
+            
+            uint32_t entry = table[(lead - 0x81) * GBK_TRAIL_COUNT + (trail - 0x40)];
+            if (entry != 0) {
+                memcpy(out, &entry, sizeof(entry));
+                out += ((const unsigned char*)&entry)[3];
+            } else {
+                memcpy(out, "\xEF\xBF\xBD", 3);
+                out += 3;
+            }
+            ptr += 2;
+        }
+    }
+    return (size_t)(out - output);
+}
+
+// 统一输入为UTF-8 - UTF-8输入原样使用，不复制；GBK输入转码到新分配的缓冲区，原输入随即释放
+// encoding为ENCODING_AUTO时与detect_encoding的判断相同，只是GBK结构检查在转码的同时完成，不是GBK时丢弃转码结果
+// 系统不支持GBK转换时按原样处理
+void decode_input(InputBuffer* input, TextEncoding encoding) {
+    if (encoding == ENCODING_UTF8) {
+        return;
+    }
+    if (encoding == ENCODING_AUTO && ((input->size >= 3 && memcmp(input->data, "\xEF\xBB\xBF", 3) == 0) ||
+                                      is_valid_utf8(input->data, input->size))) {
+        return;
+    }
+    
+    const uint32_t* table = get_gbk_table();
+    if (table == NULL) {
+        return;
+    }
+    
+    char* buffer = (char*)malloc(input->size + input->size / 2 + 4);
+    if (buffer == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    bool paired = true;
+    size_t length = transcode_gbk(table, input->data, input->size, buffer, &paired);
+    if (encoding == ENCODING_AUTO && !paired) {
+        free(buffer);
+        return;
+    }
+    release_input(input);
+    input->data = buffer;
+    input->size = length;
+    input->owned = buffer;
+}
+
+// 获取编码名称
+const char* encoding_name(TextEncoding encoding) {
+    switch (encoding) {
+        case ENCODING_UTF8: return "utf8";
+        case ENCODING_GBK: return "gbk";
+        default: return "auto";
+    }
+}
+
+// 解析编码名称
+bool parse_encoding_name(const char* name, TextEncoding* encoding) {
+    if (strcmp(name, "auto") == 0) {
+        *encoding = ENCODING_AUTO;
+    } else if (strcmp(name, "utf8") == 0 || strcmp(name, "utf-8") == 0) {
+        *encoding = ENCODING_UTF8;
+    } else if (strcmp(name, "gbk") == 0) {
+        *encoding = ENCODING_GBK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 判断一行是否为候选行 - 代码块外为#开头的行或最多3个空格缩进后以`、~开头的行，代码块内只看结束围栏
+bool is_candidate_line(const BlockState* state, const char* ptr, const char* end) {
+    if (state->fence_char == 0 && ptr < end && *ptr == '#') {
+        return true;
+    }
+    
+    for (int spaces = 0; spaces < 3 && ptr < end && *ptr == ' '; spaces++) {
+        ptr++;
+    }
+    if (ptr >= end) {
+        return false;
+    }
+    if (state->fence_char != 0) {
+        return *ptr == state->fence_char;
+    }
+    return *ptr == '`' || *ptr == '~';
+}
+
+// 查找下一个候选行（可能的标题行或围栏行），候选范围由块状态决定
+// ptr必须位于行首，line_number为该行行号；返回候选行行首并同步行号，找不到时返回end
+// 正文行只做向量化的比较，不进入scan_block_line；缩进的围栏只在换行符后紧跟空格时才逐级检查
+const char* find_heading_candidate(const BlockState* state, const char* ptr, const char* end, int* line_number) {
+    if (is_candidate_line(state, ptr, end)) {
+        return ptr;
+    }
+    
+    int lines = 0;
+    // 代码块内不找#，所有字符比较都换成结束围栏字符
+    char head = state->fence_char != 0 ? state->fence_char : '#';
+    char fence_a = state->fence_char != 0 ? state->fence_char : '`';
+    char fence_b = state->fence_char != 0 ? state->fence_char : '~';
+    
+    #if !defined(MTMT_NO_SIMD) && defined(__AVX2__)
+    // 每次比较32字节：换行符位置与下一字节为候选字符的位置按位与，下一字节为空格时再看后面三个字节
+    const __m256i newline_vec = _mm256_set1_epi8('\n');
+    const __m256i head_vec = _mm256_set1_epi8(head);
+    const __m256i fence_a_vec = _mm256_set1_epi8(fence_a);
+    const __m256i fence_b_vec = _mm256_set1_epi8(fence_b);
+    const __m256i space_vec = _mm256_set1_epi8(' ');
+    while (end - ptr > 36) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)ptr);
+        __m256i next = _mm256_loadu_si256((const __m256i*)(ptr + 1));
+        unsigned int newlines = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline_vec));
+        __m256i heads = _mm256_or_si256(_mm256_cmpeq_epi8(next, head_vec),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(next, fence_a_vec), _mm256_cmpeq_epi8(next, fence_b_vec)));
+        unsigned int candidates = newlines & (unsigned int)_mm256_movemask_epi8(heads);
+        
+        unsigned int indented = newlines & (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(next, space_vec));
+        if (indented != 0) {
+            // 这32字节及之后3个字节中没有围栏字符时，缩进的行都不可能是围栏；围栏字符很少出现，大多数块在这里就结束
+            __m256i tail = _mm256_loadu_si256((const __m256i*)(ptr + 4));
+            __m256i near = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(next, fence_a_vec), _mm256_cmpeq_epi8(next, fence_b_vec)),
+                                   _mm256_or_si256(_mm256_cmpeq_epi8(tail, fence_a_vec), _mm256_cmpeq_epi8(tail, fence_b_vec)));
+            if (_mm256_movemask_epi8(near) != 0) {
+                __m256i fences = _mm256_setzero_si256();
+                __m256i spaces = _mm256_set1_epi8(-1);
+                for (int offset = 2; offset <= 4; offset++) {
+                    __m256i shifted = _mm256_loadu_si256((const __m256i*)(ptr + offset));
+                    spaces = _mm256_and_si256(spaces, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(ptr + offset - 1)), space_vec));
+                    __m256i fence = _mm256_or_si256(_mm256_cmpeq_epi8(shifted, fence_a_vec), _mm256_cmpeq_epi8(shifted, fence_b_vec));
+                    fences = _mm256_or_si256(fences, _mm256_and_si256(spaces, fence));
+                }
+                candidates |= indented & (unsigned int)_mm256_movemask_epi8(fences);
+            }
+        }
+        
+        if (candidates != 0) {
+            int bit = __builtin_ctz(candidates);
+            lines += __builtin_popcount(newlines & ((2u << bit) - 1));
+            *line_number += lines;
+            return ptr + bit + 1;
+        }
+        
+        lines += __builtin_popcount(newlines);
+        ptr += 32;
+    }
+    #elif !defined(MTMT_NO_SIMD) && defined(__SSE2__)
+    // 每次比较16字节：换行符位置与下一字节为候选字符的位置按位与，下一字节为空格时再看后面三个字节
+    const __m128i newline_vec = _mm_set1_epi8('\n');
+    const __m128i head_vec = _mm_set1_epi8(head);
+    const __m128i fence_a_vec = _mm_set1_epi8(fence_a);
+    const __m128i fence_b_vec = _mm_set1_epi8(fence_b);
+    const __m128i space_vec = _mm_set1_epi8(' ');
+    while (end - ptr > 20) {
+        __m128i block = _mm_loadu_si128((const __m128i*)ptr);
+        __m128i next = _mm_loadu_si128((const __m128i*)(ptr + 1));
+        unsigned int newlines = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline_vec));
+        __m128i heads = _mm_or_si128(_mm_cmpeq_epi8(next, head_vec),
+                        _mm_or_si128(_mm_cmpeq_epi8(next, fence_a_vec), _mm_cmpeq_epi8(next, fence_b_vec)));
+        unsigned int candidates = newlines & (unsigned int)_mm_movemask_epi8(heads);
+        
+        unsigned int indented = newlines & (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(next, space_vec));
+        if (indented != 0) {
+            // 这16字节及之后3个字节中没有围栏字符时，缩进的行都不可能是围栏；围栏字符很少出现，大多数块在这里就结束
+            __m128i tail = _mm_loadu_si128((const __m128i*)(ptr + 4));
+            __m128i near = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(next, fence_a_vec), _mm_cmpeq_epi8(next, fence_b_vec)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(tail, fence_a_vec), _mm_cmpeq_epi8(tail, fence_b_vec)));
+            if (_mm_movemask_epi8(near) != 0) {
+                __m128i fences = _mm_setzero_si128();
+                __m128i spaces = _mm_set1_epi8(-1);
+                for (int offset = 2; offset <= 4; offset++) {
+                    __m128i shifted = _mm_loadu_si128((const __m128i*)(ptr + offset));
+                    spaces = _mm_and_si128(spaces, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr + offset - 1)), space_vec));
+                    __m128i fence = _mm_or_si128(_mm_cmpeq_epi8(shifted, fence_a_vec), _mm_cmpeq_epi8(shifted, fence_b_vec));
+                    fences = _mm_or_si128(fences, _mm_and_si128(spaces, fence));
+                }
+                candidates |= indented & (unsigned int)_mm_movemask_epi8(fences);
+            }
+        }
+        
+        if (candidates != 0) {
+            int bit = __builtin_ctz(candidates);
+            lines += __builtin_popcount(newlines & ((2u << bit) - 1));
+            *line_number += lines;
+            return ptr + bit + 1;
+        }
+        
+        lines += __builtin_popcount(newlines);
+        ptr += 16;
+    }
+    #else
+    (void)head;
+    (void)fence_a;
+    (void)fence_b;
+    #endif
+    
+    // 标量路径：处理剩余字节，或在不支持SIMD时处理全部输入
+    while (ptr < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        if (newline == NULL) {
+            break;
+        }
+        
+        lines++;
+        ptr = newline + 1;
+        if (is_candidate_line(state, ptr, end)) {
+            *line_number += lines;
+            return ptr;
+        }
+    }
+    
+    *line_number += lines;
+    return end;
+}
+
+// 查找下一个以#开头的行 - 不跟踪块状态的旧扫描方式，仅用于与find_heading_candidate做性能对比
+const char* find_hash_line(const char* ptr, const char* end, int* line_number) {
+    if (ptr < end && *ptr == '#') {
+        return ptr;
+    }
+    
+    int lines = 0;
+    
+    #if !defined(MTMT_NO_SIMD) && defined(__AVX2__)
+    // 每次比较32字节：换行符位置与下一字节为#的位置按位与
+    const __m256i newline_vec = _mm256_set1_epi8('\n');
+    const __m256i hash_vec = _mm256_set1_epi8('#');
+    while (end - ptr > 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)ptr);
+        __m256i next = _mm256_loadu_si256((const __m256i*)(ptr + 1));
+        unsigned int newlines = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline_vec));
+        unsigned int hashes = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(next, hash_vec));
+        unsigned int candidates = newlines & hashes;
+        
+        if (candidates != 0) {
+            int bit = __builtin_ctz(candidates);
+            lines += __builtin_popcount(newlines & ((2u << bit) - 1));
+            *line_number += lines;
+            return ptr + bit + 1;
+        }
+        
+        lines += __builtin_popcount(newlines);
+        ptr += 32;
+    }
+    #elif !defined(MTMT_NO_SIMD) && defined(__SSE2__)
+    // 每次比较16字节：换行符位置与下一字节为#的位置按位与
+    const __m128i newline_vec = _mm_set1_epi8('\n');
+    const __m128i hash_vec = _mm_set1_epi8('#');
+    while (end - ptr > 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)ptr);
+        __m128i next = _mm_loadu_si128((const __m128i*)(ptr + 1));
+        unsigned int newlines = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline_vec));
+        unsigned int hashes = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(next, hash_vec));
+        unsigned int candidates = newlines & hashes;
+        
+        if (candidates != 0) {
+            int bit = __builtin_ctz(candidates);
+            lines += __builtin_popcount(newlines & ((2u << bit) - 1));
+            *line_number += lines;
+            return ptr + bit + 1;
+        }
+        
+        lines += __builtin_popcount(newlines);
+        ptr += 16;
+    }
+    #endif
+    
+    // 标量路径：处理剩余字节，或在不支持SIMD时处理全部输入
+    while (ptr < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        if (newline == NULL) {
+            break;
+        }
+        
+        lines++;
+        ptr = newline + 1;
+        if (ptr < end && *ptr == '#') {
+            *line_number += lines;
+            return ptr;
+        }
+    }
+    
+    *line_number += lines;
+    return end;
+}
+
+// 按块状态判断一行 - 围栏行更新状态并返回false，围栏代码块外的ATX标题返回true
+// 开始围栏为最多3个空格缩进后的3个以上`或~，`围栏的信息字符串中不能有`；
+// 结束围栏使用相同字符、不短于开始围栏、之后只有空白；没有结束围栏的代码块延续到文档末尾
+bool scan_block_line(BlockState* state, const char* line, size_t length, int* level, const char** title, size_t* title_length) {
+    if (length > 0 && *line == '#') {
+        return state->fence_char == 0 && is_atx_heading(line, length, level, title, title_length);
+    }
+    
+    const char* ptr = line;
+    const char* end = line + length;
+    
+    for (int spaces = 0; spaces < 3 && ptr < end && *ptr == ' '; spaces++) {
+        ptr++;
+    }
+    
+    if (ptr < end && (*ptr == '`' || *ptr == '~')) {
+        char fence = *ptr;
+        const char* run = ptr;
+        while (ptr < end && *ptr == fence) ptr++;
+        int count = (int)(ptr - run);
+        
+        if (state->fence_char != 0) {
+            if (fence == state->fence_char && count >= state->fence_length) {
+                while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) ptr++;
+                if (ptr == end) {
+                    state->fence_char = 0;
+                    state->fence_length = 0;
+                }
+            }
+        } else if (count >= 3 && (fence == '~' || memchr(ptr, '`', (size_t)(end - ptr)) == NULL)) {
+            state->fence_char = fence;
+            state->fence_length = count;
+        }
+        return false;
+    }
+    
+    if (state->fence_char != 0) {
+        return false;
+    }
+    return is_atx_heading(line, length, level, title, title_length);
+}
+
+// 判断是否为front matter分隔行 - 整行为---、+++或...（允许行尾空白），返回分隔字符，否则返回0
+char front_matter_delimiter(const char* line, const char* end) {
+    if (end - line < 3 || (line[0] != '-' && line[0] != '+' && line[0] != '.') ||
+        line[1] != line[0] || line[2] != line[0]) {
+        return 0;
+    }
+    
+    for (const char* ptr = line + 3; ptr < end; ptr++) {
+        if (*ptr != ' ' && *ptr != '\t' && *ptr != '\r') return 0;
+    }
+    return line[0];
+}
+
+// 查找front matter的结束分隔行（---之后为---或...，+++之后为+++），返回该行行首，[ptr, end)中没有时返回NULL
+const char* find_front_matter_close(char delimiter, const char* ptr, const char* end) {
+    while (ptr < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        char found = front_matter_delimiter(ptr, newline ? newline : end);
+        if (found == delimiter || (found == '.' && delimiter == '-')) {
+            return ptr;
+        }
+        if (newline == NULL) break;
+        ptr = newline + 1;
+    }
+    return NULL;
+}
+
+// 判断文档开头是否为还没有结束行的front matter - 首行是---或+++，但[data, end)中没有对应的结束行
+// 此时还不能确定首行是front matter还是分隔线：流式输入要继续读入，增量解析时之后的任何编辑都可能改变结果
+bool front_matter_pending(const char* data, const char* end) {
+    if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3;
+    }
+    
+    const char* newline = (const char*)memchr(data, '\n', (size_t)(end - data));
+    char delimiter = front_matter_delimiter(data, newline ? newline : end);
+    if (delimiter != '-' && delimiter != '+') {
+        return false;
+    }
+    return newline == NULL || find_front_matter_close(delimiter, newline + 1, end) == NULL;
+}
+
+// 文档开始 - 重置块状态并跳过UTF-8 BOM，首行为---（YAML）或+++（TOML）且之后有结束分隔行时进入front matter并返回下一行行首，
+// 否则返回首行行首；没有结束行时首行只是分隔线，文档按正文扫描。[ptr, end)须为整个文档
+const char* begin_block_scan(BlockState* state, const char* ptr, const char* end, int* line_number) {
+    state->fence_char = 0;
+    state->fence_length = 0;
+    state->front_matter = 0;
+    
+    // UTF-8 BOM不属于首行内容
+    if (end - ptr >= 3 && memcmp(ptr, "\xEF\xBB\xBF", 3) == 0) {
+        ptr += 3;
+    }
+    
+    const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+    char delimiter = front_matter_delimiter(ptr, newline ? newline : end);
+    if ((delimiter != '-' && delimiter != '+') || newline == NULL ||
+        find_front_matter_close(delimiter, newline + 1, end) == NULL) {
+        return ptr;
+    }
+    
+    state->front_matter = delimiter;
+    (*line_number)++;
+    return newline + 1;
+}
+
+// 跳过front matter - 逐行查找结束分隔行（---之后为---或...，+++之后为+++），返回之后的行首
+// 不在front matter中时原样返回；分块输入时到达end仍未结束则状态保持不变，下一块继续查找
+const char* skip_front_matter(BlockState* state, const char* ptr, const char* end, int* line_number) {
+    while (state->front_matter != 0 && ptr < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        char delimiter = front_matter_delimiter(ptr, newline ? newline : end);
+        if (delimiter == state->front_matter || (delimiter == '.' && state->front_matter == '-')) {
+            state->front_matter = 0;
+        }
+        
+        if (newline == NULL) {
+            return end;
+        }
+        ptr = newline + 1;
+        (*line_number)++;
+    }
+    return ptr;
+}
+
+// 记录一个围栏行，block为处理该行之后的块状态
+void record_fence_line(IncrementalState* state, int line_number, const BlockState* block) {
+    if (state->fence_count == state->fence_capacity) {
+        int capacity = state->fence_capacity > 0 ? state->fence_capacity * 2 : FENCE_LINES_INITIAL;
+        FenceLine* fences = (FenceLine*)realloc(state->fences, (size_t)capacity * sizeof(FenceLine));
+        if (fences == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        state->fences = fences;
+        state->fence_capacity = capacity;
+    }
+    
+    FenceLine* fence = &state->fences[state->fence_count++];
+    fence->line_number = line_number;
+    fence->fence_char = block->fence_char;
+    fence->fence_length = block->fence_length;
+}
+
+// 上次解析时第line_number行开始处的块状态 - 由该行之前的最后一个围栏行决定，需在front matter之后
+BlockState block_state_at(const IncrementalState* state, int line_number) {
+    BlockState block = { 0, 0, 0 };
+    int low = 0, high = state->fence_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (state->fences[mid].line_number < line_number) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    if (low > 0) {
+        block.fence_char = state->fences[low - 1].fence_char;
+        block.fence_length = state->fences[low - 1].fence_length;
+    }
+    return block;
+}
+
+// 解析内存中的Markdown文本 - 跳过front matter，只对候选行按块状态做ATX格式标题判断
+// 围栏行同时记入增量解析状态，供之后的增量解析得到区域开始处的块状态
+void parse_markdown_buffer(ParserContext* ctx, const char* data, size_t size, int max_level) {
+    const char* ptr = data;
+    const char* end = data + size;
+    int line_number = 1;
+    
+    free_tree(ctx);
+    ctx->max_level = max_level;
+    ctx->root = create_node(ctx, 0, "Document Structure", strlen("Document Structure"), 0);
+    
+    BlockState block;
+    ptr = begin_block_scan(&block, ptr, end, &line_number);
+    ptr = skip_front_matter(&block, ptr, end, &line_number);
+    ctx->incremental.fence_count = 0;
+    ctx->incremental.body_line = front_matter_pending(data, end) ? INT_MAX : line_number;
+    
+    STATS_BEGIN(&ctx->stats, scan_timer, PHASE_SCAN);
+    while ((ptr = find_heading_candidate(&block, ptr, end, &line_number)) < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        const char* line_end = newline ? newline : end;
+        
+        int level;
+        const char* title;
+        size_t title_length;
+        char fence_char = block.fence_char;
+        STATS_ADD(&ctx->stats, candidates, 1);
+        
+        // 只处理ATX格式标题，忽略Setext格式
+        if (scan_block_line(&block, ptr, (size_t)(line_end - ptr), &level, &title, &title_length)) {
+            STATS_ADD(&ctx->stats, headings[level], 1);
+            if (level <= max_level) {
+                STATS_BEGIN(&ctx->stats, build_timer, PHASE_BUILD);
+                normalize_title(title, title_length, &ctx->title);
+                HeadingNode* node = create_title_node(ctx, level, &ctx->title, line_number);
+                add_to_tree(ctx, node);
+                STATS_END(&ctx->stats, build_timer);
+            }
+        } else if (block.fence_char != fence_char) {
+            record_fence_line(&ctx->incremental, line_number, &block);
+        }
+        
+        if (newline == NULL) {
+            break;
+        }
+        ptr = newline + 1;
+        line_number++;
+    }
+    int line_count = line_number - 1 + (size > 0 && data[size - 1] != '\n');
+    STATS_ADD(&ctx->stats, lines_scanned, line_count);
+    STATS_END(&ctx->stats, scan_timer);
+    
+    // 完整解析的结果可作为之后按编辑范围增量解析的基础
+    ctx->incremental.line_count = line_count;
+    ctx->incremental.valid = true;
+}
+
+// 扫描一个分块 - 只记录候选行，不做标题判断；空块状态的候选行包含了代码块内的结束围栏
+void* scan_chunk(void* arg) {
+    ChunkScan* chunk = (ChunkScan*)arg;
+    const BlockState outside = { 0, 0, 0 };
+    const char* ptr = chunk->start;
+    const char* end = chunk->end;
+    int line_number = 1;
+    
+    while ((ptr = find_heading_candidate(&outside, ptr, end, &line_number)) < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        const char* line_end = newline ? newline : end;
+        
+        if (chunk->count == chunk->capacity) {
+            int capacity = chunk->capacity > 0 ? chunk->capacity * 2 : HEADING_INDEX_INITIAL;
+            CandidateLine* records = (CandidateLine*)realloc(chunk->records, (size_t)capacity * sizeof(CandidateLine));
+            if (records == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            chunk->records = records;
+            chunk->capacity = capacity;
+        }
+        
+        CandidateLine* record = &chunk->records[chunk->count++];
+        record->line = ptr;
+        record->length = (uint32_t)(line_end - ptr);
+        record->line_number = line_number;
+        
+        if (newline == NULL) break;
+        ptr = newline + 1;
+        line_number++;
+    }
+    
+    // 除最后一块外每块都以换行符结束，扫描结束时的行号减一即为块内换行符数
+    chunk->lines = line_number - 1;
+    return NULL;
+}
+
+// 把输入按换行符切成threads块并行扫描，返回实际块数；输入太小时块数会少于threads
+// 各块的行号仍是块内行号，由调用方按块顺序累加换行符数修正
+int scan_chunks_parallel(const char* data, size_t size, int threads, ChunkScan** chunks) {
+    size_t max_chunks = size / PARALLEL_CHUNK_MIN;
+    int count = threads;
+    if ((size_t)count > max_chunks) count = (int)max_chunks;
+    if (count < 1) count = 1;
+    
+    ChunkScan* scans = (ChunkScan*)calloc((size_t)count, sizeof(ChunkScan));
+    pthread_t* workers = (pthread_t*)malloc((size_t)count * sizeof(pthread_t));
+    bool* started = (bool*)calloc((size_t)count, sizeof(bool));
+    if (scans == NULL || workers == NULL || started == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    const char* end = data + size;
+    const char* start = data;
+    for (int i = 0; i < count; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < count) {
+            const char* target = data + size / (size_t)count * (size_t)(i + 1);
+            if (target < start) target = start;
+            const char* newline = (const char*)memchr(target, '\n', (size_t)(end - target));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        scans[i].start = start;
+        scans[i].end = chunk_end;
+        start = chunk_end;
+    }
+    
+    // 第一块由当前线程扫描，其余块各用一个线程，创建失败时也在当前线程完成
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&workers[i], NULL, scan_chunk, &scans[i]) == 0;
+    }
+    scan_chunk(&scans[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            scan_chunk(&scans[i]);
+        }
+    }
+    
+    free(workers);
+    free(started);
+    *chunks = scans;
+    return count;
+}
+
+// 释放分块扫描结果
+void free_chunk_scans(ChunkScan* chunks, int count) {
+    for (int i = 0; i < count; i++) {
+        free(chunks[i].records);
+    }
+    free(chunks);
+}
+
+// 多线程解析 - 各线程扫描分块得到候选行，再按文档顺序修正行号、由块状态判断、建节点并链接到树上
+// 块状态和建树必须按顺序进行，但只涉及候选行本身；逐字节的扫描部分由多个线程分担
+// 结果与parse_markdown_buffer完全相同；上下文threads为1或输入较小时直接顺序解析
+void parse_markdown_parallel(ParserContext* ctx, const char* data, size_t size, int max_level) {
+    if (ctx->threads <= 1 || size < 2 * (size_t)PARALLEL_CHUNK_MIN) {
+        parse_markdown_buffer(ctx, data, size, max_level);
+        return;
+    }
+    
+    free_tree(ctx);
+    ctx->max_level = max_level;
+    ctx->root = create_node(ctx, 0, "Document Structure", strlen("Document Structure"), 0);
+    
+    // front matter只可能在文档开头，先顺序跳过
+    BlockState block;
+    const char* end = data + size;
+    int line_number = 1;
+    const char* ptr = begin_block_scan(&block, data, end, &line_number);
+    ptr = skip_front_matter(&block, ptr, end, &line_number);
+    ctx->incremental.fence_count = 0;
+    ctx->incremental.body_line = front_matter_pending(data, end) ? INT_MAX : line_number;
+    
+    STATS_BEGIN(&ctx->stats, scan_timer, PHASE_SCAN);
+    ChunkScan* chunks;
+    int count = scan_chunks_parallel(ptr, (size_t)(end - ptr), ctx->threads, &chunks);
+    
+    int line_offset = line_number - 1;
+    for (int i = 0; i < count; i++) {
+        STATS_ADD(&ctx->stats, candidates, chunks[i].count);
+        for (int j = 0; j < chunks[i].count; j++) {
+            const CandidateLine* record = &chunks[i].records[j];
+            int level;
+            const char* title;
+            size_t title_length;
+            char fence_char = block.fence_char;
+            
+            if (scan_block_line(&block, record->line, record->length, &level, &title, &title_length)) {
+                STATS_ADD(&ctx->stats, headings[level], 1);
+                if (level <= max_level) {
+                    STATS_BEGIN(&ctx->stats, build_timer, PHASE_BUILD);
+                    normalize_title(title, title_length, &ctx->title);
+                    HeadingNode* node = create_title_node(ctx, level, &ctx->title, record->line_number + line_offset);
+                    add_to_tree(ctx, node);
+                    STATS_END(&ctx->stats, build_timer);
+                }
+            } else if (block.fence_char != fence_char) {
+                record_fence_line(&ctx->incremental, record->line_number + line_offset, &block);
+            }
+        }
+        line_offset += chunks[i].lines;
+    }
+    int line_count = line_offset + (data[size - 1] != '\n');
+    STATS_ADD(&ctx->stats, lines_scanned, line_count);
+    STATS_END(&ctx->stats, scan_timer);
+    
+    free_chunk_scans(chunks, count);
+    ctx->incremental.line_count = line_count;
+    ctx->incremental.valid = true;
+}
+
+// 64位哈希（xxHash64算法），用于行哈希和文件内容哈希
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed) {
+    const unsigned char* ptr = (const unsigned char*)data;
+    const unsigned char* end = ptr + length;
+    uint64_t hash;
+    uint64_t lane;
+    uint32_t half;
+    
+    if (length >= 32) {
+        uint64_t v[4] = { seed + HASH_PRIME1 + HASH_PRIME2, seed + HASH_PRIME2, seed, seed - HASH_PRIME1 };
+        
+        while (end - ptr >= 32) {
+            for (int i = 0; i < 4; i++) {
+                memcpy(&lane, ptr + i * 8, 8);
+                v[i] += lane * HASH_PRIME2;
+                v[i] = HASH_ROTL(v[i], 31) * HASH_PRIME1;
+            }
+            ptr += 32;
+        }
+        
+        hash = HASH_ROTL(v[0], 1) + HASH_ROTL(v[1], 7) + HASH_ROTL(v[2], 12) + HASH_ROTL(v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash ^= HASH_ROTL(v[i] * HASH_PRIME2, 31) * HASH_PRIME1;
+            hash = hash * HASH_PRIME1 + HASH_PRIME4;
+        }
+    } else {
+        hash = seed + HASH_PRIME5;
+    }
+    
+    hash += (uint64_t)length;
+    
+    while (end - ptr >= 8) {
+        memcpy(&lane, ptr, 8);
+        hash ^= HASH_ROTL(lane * HASH_PRIME2, 31) * HASH_PRIME1;
+        hash = HASH_ROTL(hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+        ptr += 8;
+    }
+    
+    if (end - ptr >= 4) {
+        memcpy(&half, ptr, 4);
+        hash ^= (uint64_t)half * HASH_PRIME1;
+        hash = HASH_ROTL(hash, 23) * HASH_PRIME2 + HASH_PRIME3;
+        ptr += 4;
+    }
+    
+    while (ptr < end) {
+        hash ^= (uint64_t)(*ptr++) * HASH_PRIME5;
+        hash = HASH_ROTL(hash, 11) * HASH_PRIME1;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// 在标题索引中二分查找第一个行号不小于line_number的标题
+int find_first_heading_at(const ParserContext* ctx, int line_number) {
+    int low = 0, high = ctx->headings.count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (ctx->headings.items[mid]->line_number < line_number) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// 把树截断为只含前keep个标题 - 只有最后一个保留标题及其祖先可能指向被截掉的节点
+void truncate_tree(ParserContext* ctx, int keep) {
+    HeadingNode* child = NULL;
+    HeadingNode* node = keep > 0 ? ctx->headings.items[keep - 1] : ctx->root;
+    
+    while (node != NULL) {
+        if (child == NULL) {
+            node->first_child = NULL;
+            node->last_child = NULL;
+        } else {
+            child->next_sibling = NULL;
+            node->last_child = child;
+        }
+        child = node;
+        node = node->parent;
+    }
+    
+    ctx->headings.count = keep;
+}
+
+// 替换一段行区域 - 旧文档的[first_line, old_end_line)行换成新文档的[first_line, new_end_line)行
+// region/end为新区域在新文档中的范围；之前的标题原样保留，区域内重新扫描，之后的标题平移行号后重新链接
+// 区域涉及front matter，或区域之后的块状态发生变化（例如新增了未闭合的围栏）时返回false，调用方需完整解析
+bool splice_heading_region(ParserContext* ctx, const char* region, const char* end, int first_line, int old_end_line, int new_end_line) {
+    IncrementalState* state = &ctx->incremental;
+    if (first_line <= state->body_line) {
+        return false;
+    }
+    
+    BlockState block = block_state_at(state, first_line);
+    BlockState old_after = block_state_at(state, old_end_line);
+    
+    int keep = find_first_heading_at(ctx, first_line);
+    int tail_start = find_first_heading_at(ctx, old_end_line);
+    int tail_count = ctx->headings.count - tail_start;
+    int delta = new_end_line - old_end_line;
+    
+    HeadingNode** tail = NULL;
+    if (tail_count > 0) {
+        tail = (HeadingNode**)malloc((size_t)tail_count * sizeof(HeadingNode*));
+        if (tail == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        memcpy(tail, ctx->headings.items + tail_start, (size_t)tail_count * sizeof(HeadingNode*));
+    }
+    
+    // 区域之后的围栏行暂存起来，区域内的围栏行重新记录
+    int fence_keep = 0;
+    while (fence_keep < state->fence_count && state->fences[fence_keep].line_number < first_line) fence_keep++;
+    int fence_tail_start = fence_keep;
+    while (fence_tail_start < state->fence_count && state->fences[fence_tail_start].line_number < old_end_line) fence_tail_start++;
+    int fence_tail_count = state->fence_count - fence_tail_start;
+    
+    FenceLine* fence_tail = NULL;
+    if (fence_tail_count > 0) {
+        fence_tail = (FenceLine*)malloc((size_t)fence_tail_count * sizeof(FenceLine));
+        if (fence_tail == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        memcpy(fence_tail, state->fences + fence_tail_start, (size_t)fence_tail_count * sizeof(FenceLine));
+    }
+    state->fence_count = fence_keep;
+    
+    state->stale_nodes += tail_start - keep;
+    truncate_tree(ctx, keep);
+    
+    // 从区域开始处的块状态重新扫描变化区域
+    const char* ptr = region;
+    int line_number = first_line;
+    while ((ptr = find_heading_candidate(&block, ptr, end, &line_number)) < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        const char* line_end = newline ? newline : end;
+        
+        int level;
+        const char* title;
+        size_t title_length;
+        char fence_char = block.fence_char;
+        
+        if (scan_block_line(&block, ptr, (size_t)(line_end - ptr), &level, &title, &title_length)) {
+            if (level <= ctx->max_level) {
+                normalize_title(title, title_length, &ctx->title);
+                add_to_tree(ctx, create_title_node(ctx, level, &ctx->title, line_number));
+            }
+        } else if (block.fence_char != fence_char) {
+            record_fence_line(state, line_number, &block);
+        }
+        
+        if (newline == NULL) break;
+        ptr = newline + 1;
+        line_number++;
+    }
+    
+    for (int i = 0; i < fence_tail_count; i++) {
+        BlockState after = { fence_tail[i].fence_char, 0, fence_tail[i].fence_length };
+        record_fence_line(state, fence_tail[i].line_number + delta, &after);
+    }
+    free(fence_tail);
+    
+    // 区域之后的节点复用原对象，只更新行号和链接
+    for (int i = 0; i < tail_count; i++) {
+        HeadingNode* node = tail[i];
+        node->line_number += delta;
+        node->first_child = NULL;
+        node->last_child = NULL;
+        node->next_sibling = NULL;
+        add_to_tree(ctx, node);
+    }
+    
+    free(tail);
+    return block.fence_char == old_after.fence_char && block.fence_length == old_after.fence_length;
+}
+
+// 从ptr开始跳过count行，返回之后一行的行首
+const char* skip_lines(const char* ptr, const char* end, int count) {
+    for (int i = 0; i < count && ptr < end; i++) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        ptr = newline ? newline + 1 : end;
+    }
+    return ptr;
+}
+
+// 按编辑范围增量解析 - 调用方告知从first_line开始的old_line_count行被替换为new_line_count行
+// 只扫描变化区域；没有可用的上次结果、范围越界、废弃节点过多或区域之后的块状态改变时做完整解析并返回false
+// 行数可能来自客户端，范围检查的每一步都不会溢出
+bool parse_markdown_edit(ParserContext* ctx, const char* data, size_t size, int first_line, int old_line_count, int new_line_count) {
+    IncrementalState* state = &ctx->incremental;
+    
+    if (!state->valid || ctx->root == NULL || state->stale_nodes > ctx->headings.count ||
+        first_line < 1 || old_line_count < 0 || new_line_count < 0 ||
+        first_line - 1 > state->line_count || old_line_count > state->line_count - (first_line - 1) ||
+        new_line_count > INT_MAX - first_line) {
+        parse_markdown_parallel(ctx, data, size, ctx->max_level);
+        return false;
+    }
+    
+    const char* end = data + size;
+    const char* region = skip_lines(data, end, first_line - 1);
+    const char* region_end = skip_lines(region, end, new_line_count);
+    
+    if (!splice_heading_region(ctx, region, region_end, first_line, first_line + old_line_count, first_line + new_line_count)) {
+        parse_markdown_parallel(ctx, data, size, ctx->max_level);
+        return false;
+    }
+    
+    state->line_count += new_line_count - old_line_count;
+    return true;
+}
+
+// 解析Markdown文件 - 整个文件读入后在内存中扫描，读取失败时得到空树并返回false
+bool parse_markdown_file(ParserContext* ctx, FILE* file, int max_level) {
+    InputBuffer input;
+    
+    STATS_BEGIN(&ctx->stats, read_timer, PHASE_READ);
+    bool loaded = load_input(file, &input);
+    STATS_END(&ctx->stats, read_timer);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input\n");
+        parse_markdown_buffer(ctx, "", 0, max_level);
+        return false;
+    }
+    STATS_ADD(&ctx->stats, bytes_read, input.size);
+    
+    STATS_BEGIN(&ctx->stats, decode_timer, PHASE_DECODE);
+    decode_input(&input, ctx->encoding);
+    STATS_END(&ctx->stats, decode_timer);
+    parse_markdown_parallel(ctx, input.data, input.size, max_level);
+    release_input(&input);
+    return true;
+}
+
+// 渲染思维导图到输出缓冲区，前缀栈复用上下文中的缓冲区
+void render_mind_map(ParserContext* ctx, OutputBuffer* output) {
+    if (ctx->root == NULL || ctx->root->first_child == NULL) {
+        char message[64];
+        snprintf(message, sizeof(message), "No headings found at level %d or below\n", ctx->max_level);
+        output_puts(output, message);
+        return;
+    }
+    
+    output_puts(output, "[D] Document Structure\n");
+    
+    ctx->prefix.length = 0;
+    
+    HeadingNode* child = ctx->root->first_child;
+    while (child != NULL) {
+        HeadingNode* next_child = child->next_sibling;
         bool last_child = (next_child == NULL);
-        print_tree(child, 0, last_child, "", output);
+        print_tree(child, 0, last_child, &ctx->prefix, output);
         child = next_child;
     }
 }
 
-// 获取用户输入
-void get_user_input(char* filename, int* max_level) {
-    printf("==========================================\n");
-    printf("      Markdown Mind Map Generator\n");
-    printf("==========================================\n\n");
+// 打印思维导图 - 经输出缓冲区按块写入文件
+void print_mind_map(ParserContext* ctx, FILE* output) {
+    OutputBuffer buffer;
+    output_init(&buffer, output);
+    render_mind_map(ctx, &buffer);
+    output_flush(&buffer);
+    output_free(&buffer);
+}
+
+// 把十进制整数写到buffer（至少12字节，不加'\0'），返回长度；导出时代替printf
+int format_int(char* buffer, int value) {
+    char digits[12];
+    int count = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    
+    int length = 0;
+    if (value < 0) buffer[length++] = '-';
+    while (count > 0) buffer[length++] = digits[--count];
+    return length;
+}
+
+// 写入十进制整数
+void output_int(OutputBuffer* output, int value) {
+    char buffer[12];
+    output_write(output, buffer, (size_t)format_int(buffer, value));
+}
+
+// 写入JSON字符串（含两侧引号）- 转义引号、反斜杠和控制字符，其余字节（包括UTF-8多字节字符）按段原样写出
+void output_json_string(OutputBuffer* output, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    const char* run = text;
+    
+    const char* ptr = text;
+    
+    output_write(output, "\"", 1);
+    for (; *ptr != '\0'; ptr++) {
+        unsigned char c = (unsigned char)*ptr;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        
+        output_write(output, run, (size_t)(ptr - run));
+        run = ptr + 1;
+        
+        switch (c) {
+            case '"': output_write(output, "\\\"", 2); break;
+            case '\\': output_write(output, "\\\\", 2); break;
+            case '\t': output_write(output, "\\t", 2); break;
+            case '\n': output_write(output, "\\n", 2); break;
+            case '\r': output_write(output, "\\r", 2); break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+                output_write(output, escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    output_write(output, run, (size_t)(ptr - run));
+    output_write(output, "\"", 1);
+}
+
+// 写入XML属性值（含两侧引号）- 转义&<>"和制表符，XML 1.0不允许的其他控制字符替换为空格
+void output_xml_attribute(OutputBuffer* output, const char* text) {
+    const char* run = text;
+    
+    const char* ptr = text;
+    
+    output_write(output, "\"", 1);
+    for (; *ptr != '\0'; ptr++) {
+        unsigned char c = (unsigned char)*ptr;
+        if (c >= 0x20 && c != '&' && c != '<' && c != '>' && c != '"') continue;
+        
+        output_write(output, run, (size_t)(ptr - run));
+        run = ptr + 1;
+        
+        switch (c) {
+            case '&': output_puts(output, "&amp;"); break;
+            case '<': output_puts(output, "&lt;"); break;
+            case '>': output_puts(output, "&gt;"); break;
+            case '"': output_puts(output, "&quot;"); break;
+            case '\t': output_puts(output, "&#9;"); break;
+            default: output_write(output, " ", 1); break;
+        }
+    }
+    output_write(output, run, (size_t)(ptr - run));
+    output_write(output, "\"", 1);
+}
+
+// 导出JSON - 与print_tree相同地沿父指针迭代遍历，边遍历边写入输出缓冲区，不建立中间结构
+// 每个节点为{"title":..., "level":..., "line":..., "children":[...]}，叶子节点省略children，根节点代表整个文档
+void render_mind_map_json(ParserContext* ctx, OutputBuffer* output) {
+    output_puts(output, "{\"title\":\"Document Structure\",\"maxLevel\":");
+    output_int(output, ctx->max_level);
+    output_puts(output, ",\"children\":[");
+    
+    HeadingNode* root = ctx->root;
+    HeadingNode* node = root != NULL ? root->first_child : NULL;
+    
+    while (node != NULL) {
+        if (node != node->parent->first_child) output_write(output, ",", 1);
+        output_write(output, "{\"title\":", 9);
+        output_json_string(output, node->text);
+        
+        // 标题之后的定长部分先在栈上拼好，一次写入
+        char fields[64];
+        size_t length = 0;
+        memcpy(fields, ",\"level\":", 9);
+        length += 9;
+        length += (size_t)format_int(fields + length, node->level);
+        memcpy(fields + length, ",\"line\":", 8);
+        length += 8;
+        length += (size_t)format_int(fields + length, node->line_number);
+        
+        if (node->first_child != NULL) {
+            memcpy(fields + length, ",\"children\":[", 13);
+            output_write(output, fields, length + 13);
+            node = node->first_child;
+            continue;
+        }
+        
+        // 叶子节点没有children字段；关闭它以及所有已是最后一个子节点的祖先
+        fields[length++] = '}';
+        output_write(output, fields, length);
+        while (node->next_sibling == NULL && node->parent != root) {
+            node = node->parent;
+            output_write(output, "]}", 2);
+        }
+        node = node->next_sibling;
+    }
+    
+    output_puts(output, "]}\n");
+}
+
+// 导出OPML 2.0 - 每个标题是一个outline元素，按深度缩进，遍历方式与JSON导出相同
+void render_mind_map_opml(ParserContext* ctx, OutputBuffer* output) {
+    static const char indent[] = "                ";
+    
+    output_puts(output, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    output_puts(output, "<opml version=\"2.0\">\n");
+    output_puts(output, "  <head>\n    <title>Document Structure</title>\n  </head>\n");
+    output_puts(output, "  <body>\n");
+    
+    HeadingNode* root = ctx->root;
+    HeadingNode* node = root != NULL ? root->first_child : NULL;
+    int depth = 0;
+    
+    while (node != NULL) {
+        output_write(output, indent, (size_t)(depth + 2) * 2);
+        output_puts(output, "<outline text=");
+        output_xml_attribute(output, node->text);
+        
+        if (node->first_child != NULL) {
+            output_puts(output, ">\n");
+            node = node->first_child;
+            depth++;
+            continue;
+        }
+        
+        output_puts(output, "/>\n");
+        while (node->next_sibling == NULL && node->parent != root) {
+            node = node->parent;
+            depth--;
+            output_write(output, indent, (size_t)(depth + 2) * 2);
+            output_puts(output, "</outline>\n");
+        }
+        node = node->next_sibling;
+    }
+    
+    output_puts(output, "  </body>\n</opml>\n");
+}
+
+// 初始化扁平思维导图
+void flat_mind_map_init(FlatMindMap* map) {
+    memset(map, 0, sizeof(FlatMindMap));
+}
+
+// 按文档顺序追加一个标题，标题文本原样复制到字符串池并以'\0'结尾
+bool flat_mind_map_append(FlatMindMap* map, int level, int line_number, const char* title, size_t title_length) {
+    TitleSlice slice = { title, title_length };
+    TitleText text;
+    text.slices = &slice;
+    text.capacity = 1;
+    text.count = 1;
+    text.pinned = 0;
+    text.length = title_length;
+    return flat_mind_map_append_title(map, level, line_number, &text);
+}
+
+// 按文档顺序追加一个标题，显示文本的各段依次复制到字符串池并以'\0'结尾
+// 标题偏移是32位的，字符串池超过4 GiB时不追加并返回false，调用方让这次转换失败
+bool flat_mind_map_append_title(FlatMindMap* map, int level, int line_number, const TitleText* title) {
+    size_t title_length = title->length;
+    if ((uint64_t)map->pool_size + title_length + 1 > UINT32_MAX) {
+        fprintf(stderr, "Error: Heading titles exceed the 4 GiB limit of one mind map\n");
+        return false;
+    }
+    if (map->count == map->capacity) {
+        int capacity = map->capacity > 0 ? map->capacity * 2 : HEADING_INDEX_INITIAL;
+        uint8_t* levels = (uint8_t*)realloc(map->levels, (size_t)capacity * sizeof(uint8_t));
+        if (levels != NULL) map->levels = levels;
+        int* line_numbers = (int*)realloc(map->line_numbers, (size_t)capacity * sizeof(int));
+        if (line_numbers != NULL) map->line_numbers = line_numbers;
+        uint32_t* title_offsets = (uint32_t*)realloc(map->title_offsets, (size_t)capacity * sizeof(uint32_t));
+        if (title_offsets != NULL) map->title_offsets = title_offsets;
+        int* subtree_ends = (int*)realloc(map->subtree_ends, (size_t)capacity * sizeof(int));
+        if (subtree_ends != NULL) map->subtree_ends = subtree_ends;
+        
+        if (levels == NULL || line_numbers == NULL || title_offsets == NULL || subtree_ends == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        map->capacity = capacity;
+    }
+    
+    if (map->pool_size + title_length + 1 > map->pool_capacity) {
+        size_t capacity = map->pool_capacity > 0 ? map->pool_capacity * 2 : ARENA_BLOCK_SIZE;
+        while (capacity < map->pool_size + title_length + 1) {
+            capacity *= 2;
+        }
+        char* pool = (char*)realloc(map->title_pool, capacity);
+        if (pool == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        map->title_pool = pool;
+        map->pool_capacity = capacity;
+    }
+    
+    int i = map->count++;
+    map->levels[i] = (uint8_t)level;
+    map->line_numbers[i] = line_number;
+    map->title_offsets[i] = (uint32_t)map->pool_size;
+    map->subtree_ends[i] = 0;
+    
+    copy_title_text(title, map->title_pool + map->pool_size);
+    map->pool_size += title_length + 1;
+    return true;
+}
+
+// 计算每个节点的子树结束位置 - 子树结束于下一个级别不高于它的标题
+// 打开的祖先级别严格递增，栈深度不超过MAX_LEVEL
+void flat_mind_map_finish(FlatMindMap* map) {
+    int open[MAX_LEVEL + 1];
+    int depth = 0;
+    
+    for (int i = 0; i < map->count; i++) {
+        while (depth > 0 && map->levels[open[depth - 1]] >= map->levels[i]) {
+            map->subtree_ends[open[--depth]] = i;
+        }
+        open[depth++] = i;
+    }
+    
+    while (depth > 0) {
+        map->subtree_ends[open[--depth]] = map->count;
+    }
+}
+
+// 从标题索引生成扁平思维导图 - 索引已按文档顺序排列，恰好是树的先序；标题超出字符串池上限时返回false
+bool build_flat_mind_map(const ParserContext* ctx, FlatMindMap* map) {
+    map->count = 0;
+    map->pool_size = 0;
+    
+    for (int i = 0; i < ctx->headings.count; i++) {
+        HeadingNode* node = ctx->headings.items[i];
+        if (!flat_mind_map_append(map, node->level, node->line_number, node->text, strlen(node->text))) {
+            return false;
+        }
+    }
+    
+    flat_mind_map_finish(map);
+    return true;
+}
+
+// 顺序遍历扁平思维导图渲染，输出与render_mind_map一致
+void render_flat_mind_map(const FlatMindMap* map, int max_level, OutputBuffer* output) {
+    if (map->count == 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "No headings found at level %d or below\n", max_level);
+        output_puts(output, message);
+        return;
+    }
+    
+    output_puts(output, "[D] Document Structure\n");
+    render_flat_nodes(map, false, output);
+}
+
+// 渲染扁平思维导图中的全部节点（不含文件头）
+// more_follows为true时表示后面还有顶层节点，最后一个顶层节点也按非末尾节点绘制
+void render_flat_nodes(const FlatMindMap* map, bool more_follows, OutputBuffer* output) {
+    // 前缀按层追加和截断，每层最多"│   "（6字节）
+    char prefix[(MAX_LEVEL + 1) * 8];
+    size_t prefix_lengths[MAX_LEVEL + 1];
+    int ends[MAX_LEVEL + 1];
+    int depth = 0;
+    size_t prefix_length = 0;
+    
+    for (int i = 0; i < map->count; i++) {
+        while (depth > 0 && i >= ends[depth - 1]) {
+            prefix_length = prefix_lengths[--depth];
+        }
+        
+        int parent_end = depth > 0 ? ends[depth - 1] : (more_follows ? map->count + 1 : map->count);
+        bool is_last = map->subtree_ends[i] >= parent_end;
+        
+        output_write(output, prefix, prefix_length);
+        if (depth > 0) {
+            output_puts(output, is_last ? "└── " : "├── ");
+        }
+        output_puts(output, get_icon(map->levels[i]));
+        output_write(output, " ", 1);
+        output_puts(output, map->title_pool + map->title_offsets[i]);
+        output_write(output, "\n", 1);
+        
+        const char* segment = is_last ? "    " : "│   ";
+        prefix_lengths[depth] = prefix_length;
+        ends[depth++] = map->subtree_ends[i];
+        memcpy(prefix + prefix_length, segment, strlen(segment));
+        prefix_length += strlen(segment);
+    }
+}
+
+// 打印扁平思维导图 - 经输出缓冲区按块写入文件
+void print_flat_mind_map(const FlatMindMap* map, int max_level, FILE* output) {
+    OutputBuffer buffer;
+    output_init(&buffer, output);
+    render_flat_mind_map(map, max_level, &buffer);
+    output_flush(&buffer);
+    output_free(&buffer);
+}
+
+// 释放扁平思维导图
+void free_flat_mind_map(FlatMindMap* map) {
+    free(map->levels);
+    free(map->line_numbers);
+    free(map->title_offsets);
+    free(map->subtree_ends);
+    free(map->title_pool);
+    flat_mind_map_init(map);
+}
+
+// 输出二进制思维导图 - 文件头后直接写出扁平思维导图的各个数组
+void render_mind_map_binary(const FlatMindMap* map, int max_level, OutputBuffer* output) {
+    BinaryMindMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, 4);
+    header.version = BINARY_VERSION;
+    header.max_level = (uint8_t)max_level;
+    header.byte_order = BINARY_BYTE_ORDER;
+    header.count = (uint32_t)map->count;
+    header.pool_size = map->pool_size;
+    
+    size_t count = (size_t)map->count;
+    output_write(output, (const char*)&header, sizeof(header));
+    if (count > 0) {
+        output_write(output, (const char*)map->line_numbers, count * sizeof(int));
+        output_write(output, (const char*)map->title_offsets, count * sizeof(uint32_t));
+        output_write(output, (const char*)map->subtree_ends, count * sizeof(int));
+        output_write(output, (const char*)map->levels, count);
+        output_write(output, map->title_pool, map->pool_size);
+    }
+}
+
+// 映射打开二进制思维导图 - 只检查文件头和各段长度，耗时与节点数无关
+// 来源不可信的文件应再调用verify_mind_map_view检查每个节点
+bool open_mind_map_view(const char* filename, MindMapView* view) {
+    flat_mind_map_init(&view->map);
+    view->max_level = 0;
+    view->input.data = NULL;
+    view->input.size = 0;
+    view->input.mapped = false;
+    view->input.owned = NULL;
+    
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return false;
+    }
+    bool loaded = load_input(file, &view->input);
+    fclose(file);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input %s\n", filename);
+        return false;
+    }
+    
+    BinaryMindMapHeader header;
+    if (view->input.size < sizeof(header)) {
+        fprintf(stderr, "Error: %s is not a binary mind map\n", filename);
+        close_mind_map_view(view);
+        return false;
+    }
+    memcpy(&header, view->input.data, sizeof(header));
+    
+    if (memcmp(header.magic, BINARY_MAGIC, 4) != 0 || header.byte_order != BINARY_BYTE_ORDER) {
+        fprintf(stderr, "Error: %s is not a binary mind map for this platform\n", filename);
+        close_mind_map_view(view);
+        return false;
+    }
+    if (header.version != BINARY_VERSION) {
+        fprintf(stderr, "Error: Unsupported binary mind map version %d in %s\n", header.version, filename);
+        close_mind_map_view(view);
+        return false;
+    }
+    
+    uint64_t count = header.count;
+    uint64_t expected = sizeof(header) + count * (3 * sizeof(uint32_t) + 1) + header.pool_size;
+    if (expected != view->input.size || count > INT32_MAX ||
+        (header.pool_size > 0 && view->input.data[view->input.size - 1] != '\0')) {
+        fprintf(stderr, "Error: Binary mind map %s is truncated or corrupted\n", filename);
+        close_mind_map_view(view);
+        return false;
+    }
+    
+    // 各段直接指向映射内容，文件头24字节，32位数组都是4字节对齐的
+    const char* data = view->input.data + sizeof(header);
+    view->map.count = (int)count;
+    view->map.line_numbers = (int*)data;
+    view->map.title_offsets = (uint32_t*)(data + count * sizeof(uint32_t));
+    view->map.subtree_ends = (int*)(data + 2 * count * sizeof(uint32_t));
+    view->map.levels = (uint8_t*)(data + 3 * count * sizeof(uint32_t));
+    view->map.title_pool = (char*)(data + 3 * count * sizeof(uint32_t) + count);
+    view->map.pool_size = header.pool_size;
+    view->max_level = header.max_level;
+    return true;
+}
+
+// 逐个检查节点 - 级别和标题偏移有效，且子树范围与按级别重新计算的结果一致时才能安全地遍历和渲染
+bool verify_mind_map_view(const MindMapView* view) {
+    const FlatMindMap* map = &view->map;
+    if (view->max_level < 1 || view->max_level > MAX_LEVEL) return false;
+    
+    int open[MAX_LEVEL + 1];
+    int depth = 0;
+    
+    for (int i = 0; i < map->count; i++) {
+        if (map->levels[i] < 1 || map->levels[i] > MAX_LEVEL) return false;
+        if (map->title_offsets[i] >= map->pool_size) return false;
+        
+        while (depth > 0 && map->levels[open[depth - 1]] >= map->levels[i]) {
+            if (map->subtree_ends[open[--depth]] != i) return false;
+        }
+        open[depth++] = i;
+    }
+    
+    while (depth > 0) {
+        if (map->subtree_ends[open[--depth]] != map->count) return false;
+    }
+    return true;
+}
+
+// 关闭二进制思维导图，解除映射
+void close_mind_map_view(MindMapView* view) {
+    release_input(&view->input);
+    flat_mind_map_init(&view->map);
+    view->max_level = 0;
+}
+
+// 输出格式对应的文件扩展名
+const char* format_extension(OutputFormat format) {
+    switch (format) {
+        case FORMAT_BINARY: return "mtmb";
+        case FORMAT_JSON: return "json";
+        case FORMAT_OPML: return "opml";
+        default: return "txt";
+    }
+}
+
+// 解析格式名，也接受扩展名（缓存清单中按扩展名记录格式）
+bool parse_output_format(const char* name, OutputFormat* format) {
+    if (strcmp(name, "txt") == 0 || strcmp(name, "text") == 0) {
+        *format = FORMAT_TEXT;
+    } else if (strcmp(name, "bin") == 0 || strcmp(name, "binary") == 0 || strcmp(name, "mtmb") == 0) {
+        *format = FORMAT_BINARY;
+    } else if (strcmp(name, "json") == 0) {
+        *format = FORMAT_JSON;
+    } else if (strcmp(name, "opml") == 0) {
+        *format = FORMAT_OPML;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 把generate_output_filename生成的.txt扩展名换成输出格式对应的扩展名
+void set_output_extension(char* output_filename, OutputFormat format) {
+    char* dot = strrchr(output_filename, '.');
+    if (dot != NULL) {
+        strcpy(dot + 1, format_extension(format));
+    }
+}
+
+// 按输出格式渲染思维导图主体（文本格式不含文件头和文件尾）
+// 二进制格式的标题超出字符串池上限时不输出并返回false
+bool render_mind_map_body(ParserContext* ctx, OutputFormat format, OutputBuffer* output) {
+    bool ok = true;
+    STATS_BEGIN(&ctx->stats, render_timer, PHASE_RENDER);
+    switch (format) {
+        case FORMAT_BINARY: {
+            FlatMindMap map;
+            flat_mind_map_init(&map);
+            ok = build_flat_mind_map(ctx, &map);
+            if (ok) render_mind_map_binary(&map, ctx->max_level, output);
+            free_flat_mind_map(&map);
+            break;
+        }
+        case FORMAT_JSON: render_mind_map_json(ctx, output); break;
+        case FORMAT_OPML: render_mind_map_opml(ctx, output); break;
+        default: render_mind_map(ctx, output); break;
+    }
+    STATS_END(&ctx->stats, render_timer);
+    return ok;
+}
+
+// 获取用户输入
+void get_user_input(char* filename, int* max_level) {
+    printf("==========================================\n");
+    printf("      Markdown Mind Map Generator\n");
+    printf("==========================================\n\n");
+    
+    while (1) {
+        printf("Enter Markdown filename (e.g., document.md or full path): ");
+        if (fgets(filename, MAX_FILENAME, stdin) != NULL) {
+            trim_whitespace(filename);
+            if (strlen(filename) > 0) {
+                break;
+            }
+        }
+        printf("Error: Filename cannot be empty, please re-enter!\n");
+    }
+    
+    char level_input[10];
+    while (1) {
+        printf("Enter maximum heading level (1-%d, default 6): ", MAX_LEVEL);
+        if (fgets(level_input, sizeof(level_input), stdin) != NULL) {
+            trim_whitespace(level_input);
+            if (strlen(level_input) == 0) {
+                *max_level = MAX_LEVEL;
+                break;
+            }
+            
+            *max_level = atoi(level_input);
+            if (*max_level >= 1 && *max_level <= MAX_LEVEL) {
+                break;
+            }
+        }
+        printf("Error: Level must be between 1-%d, please re-enter!\n", MAX_LEVEL);
+    }
+    
+    printf("\n");
+}
+
+// 显示主菜单
+void show_main_menu(const OperationLog* log) {
+    clear_screen();
+    printf("==========================================\n");
+    printf("      Markdown Mind Map Generator\n");
+    printf("==========================================\n");
+    printf("         Total Operations: %d\n", log->total_operations);
+    printf("==========================================\n\n");
+    
+    printf("1. Process Markdown File\n");
+    printf("2. View Operation History\n");
+    printf("3. Clear Screen\n");
+    printf("4. Exit\n\n");
+    
+    printf("Please select an option (1-4): ");
+}
+
+// 处理单个文件
+void process_single_file(ParserContext* ctx, OperationLog* log) {
+    char filename[MAX_FILENAME];
+    char output_filename[MAX_FILENAME];
+    int max_level;
+    
+    clear_screen();
+    get_user_input(filename, &max_level);
+    
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open file %s\n", filename);
+        printf("Please check if the file exists or the path is correct.\n");
+        add_log_entry(log, filename, "Failed to open file");
+        printf("Press any key to continue...");
+        getchar();
+        return;
+    }
+    
+    generate_output_filename(filename, output_filename);
+    
+    FILE* output_file = fopen(output_filename, "w");
+    if (output_file == NULL) {
+        printf("Error: Cannot create output file %s\n", output_filename);
+        fclose(file);
+        add_log_entry(log, filename, "Failed to create output file");
+        printf("Press any key to continue...");
+        getchar();
+        return;
+    }
+    
+    printf("Processing file: %s\n", filename);
+    printf("Extracting headings at level %d or below...\n", max_level);
+    printf("==========================================\n\n");
+    
+    // 融合解析渲染一次，预览和保存的文件共用同一份输出
+    stats_reset(&ctx->stats);
+    STATS_BEGIN(&ctx->stats, timer, PHASE_OTHER);
+    write_mind_map_header(output_file, filename, max_level);
+    printf("Mind Map Preview:\n");
+    printf("------------------------------------------\n");
+    
+    OutputBuffer output;
+    output_init(&output, stdout);
+    output.mirror = output_file;
+    output.stats = &ctx->stats;
+    bool ok = render_markdown_file_fused(ctx, file, max_level, &output);
+    output_flush(&output);
+    output_free(&output);
+    
+    printf("------------------------------------------\n\n");
+    write_mind_map_footer(output_file);
+    
+    // 清理资源
+    fclose(file);
+    if (fclose(output_file) != 0) ok = false;
+    STATS_END(&ctx->stats, timer);
+    
+    // 读取失败或标题超出上限时输出不完整，与convert_markdown_file一样不保留输出文件
+    if (!ok) {
+        remove(output_filename);
+        printf("Error: Failed to convert %s, no mind map was saved\n\n", filename);
+        add_log_entry(log, filename, "Failed to convert file");
+        printf("Press any key to continue...");
+        getchar();
+        getchar(); // 获取回车键
+        return;
+    }
+    
+    printf("Mind map saved to: %s\n\n", output_filename);
+    if (ctx->stats.enabled) {
+        print_stats(&ctx->stats, stdout);
+        printf("\n");
+    }
+    
+    // 记录成功操作
+    char success_msg[256];
+    snprintf(success_msg, sizeof(success_msg), "Successfully processed, output: %s", output_filename);
+    add_log_entry(log, filename, success_msg);
+    if (ctx->stats.enabled) {
+        attach_log_stats(log, &ctx->stats, filename, max_level);
+    }
+    
+    printf("Press any key to continue...");
+    getchar();
+    getchar(); // 获取回车键
+}
+
+// 写入思维导图结果文件（文件头、思维导图、结尾分隔线）
+void write_mind_map_file(ParserContext* ctx, FILE* output_file, const char* filename) {
+    write_mind_map_header(output_file, filename, ctx->max_level);
+    print_mind_map(ctx, output_file);
+    write_mind_map_footer(output_file);
+}
+
+// 写入思维导图文件头
+void write_mind_map_header(FILE* output_file, const char* filename, int max_level) {
+    fprintf(output_file, "Markdown File: %s\n", filename);
+    fprintf(output_file, "Extraction Level: Level %d and below\n", max_level);
+    fprintf(output_file, "Generated: %s", __DATE__);
+    fprintf(output_file, " %s\n", __TIME__);
+    fprintf(output_file, "==========================================\n");
+}
+
+// 写入思维导图文件尾
+void write_mind_map_footer(FILE* output_file) {
+    fprintf(output_file, "==========================================\n");
+}
+
+// 添加路径到路径列表
+void path_list_add(PathList* list, const char* path) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : PATH_LIST_INITIAL;
+        char** items = (char**)realloc(list->items, (size_t)capacity * sizeof(char*));
+        if (items == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    
+    char* copy = (char*)malloc(strlen(path) + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    strcpy(copy, path);
+    list->items[list->count++] = copy;
+}
+
+// 取得文件标识，失败时返回false
+bool file_key(const char* path, const struct stat* st, FileKey* key) {
+    #ifdef _WIN32
+    (void)st;
+    char full[MAX_PATH];
+    if (_fullpath(full, path, sizeof(full)) == NULL) return false;
+    size_t length = strlen(full);
+    for (size_t i = 0; i < length; i++) {
+        full[i] = full[i] == '/' ? '\\' : (char)tolower((unsigned char)full[i]);
+    }
+    key->device = hash_bytes(full, length, 0);
+    key->inode = hash_bytes(full, length, 1);
+    #else
+    (void)path;
+    key->device = (uint64_t)st->st_dev;
+    key->inode = (uint64_t)st->st_ino;
+    #endif
+    return true;
+}
+
+// 添加一个文件到路径列表，同一文件已在列表中时忽略并返回false
+bool path_list_add_file(PathList* list, const char* path, const struct stat* st) {
+    FileKey key;
+    if (!file_key(path, st, &key)) {
+        path_list_add(list, path);
+        return true;
+    }
+    
+    if ((list->count + 1) * 2 > list->key_slots) {
+        int slots = list->key_slots > 0 ? list->key_slots * 2 : PATH_LIST_INITIAL * 2;
+        FileKey* keys = (FileKey*)calloc((size_t)slots, sizeof(FileKey));
+        if (keys == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        for (int i = 0; i < list->key_slots; i++) {
+            const FileKey* old = &list->keys[i];
+            if (old->device == 0 && old->inode == 0) continue;
+            int slot = (int)(hash_bytes(old, sizeof(FileKey), 0) & (uint64_t)(slots - 1));
+            while (keys[slot].device != 0 || keys[slot].inode != 0) slot = (slot + 1) & (slots - 1);
+            keys[slot] = *old;
+        }
+        free(list->keys);
+        list->keys = keys;
+        list->key_slots = slots;
+    }
+    
+    int slot = (int)(hash_bytes(&key, sizeof(FileKey), 0) & (uint64_t)(list->key_slots - 1));
+    while (list->keys[slot].device != 0 || list->keys[slot].inode != 0) {
+        if (list->keys[slot].device == key.device && list->keys[slot].inode == key.inode) return false;
+        slot = (slot + 1) & (list->key_slots - 1);
+    }
+    list->keys[slot] = key;
+    path_list_add(list, path);
+    return true;
+}
+
+// 释放路径列表
+void path_list_free(PathList* list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    free(list->keys);
+    list->keys = NULL;
+    list->key_slots = 0;
+}
+
+// 判断文件名是否以.md结尾（不区分大小写）
+bool has_markdown_extension(const char* name) {
+    size_t length = strlen(name);
+    return length > 3 && name[length - 3] == '.' &&
+           tolower((unsigned char)name[length - 2]) == 'm' &&
+           tolower((unsigned char)name[length - 1]) == 'd';
+}
+
+// 收集Markdown文件 - 目录递归查找.md文件（跳过以.开头的隐藏项和符号链接），普通文件直接加入；同一文件只加入一次
+void collect_markdown_files(const char* path, PathList* list) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Error: Cannot access %s\n", path);
+        return;
+    }
+    
+    if (!S_ISDIR(st.st_mode)) {
+        path_list_add_file(list, path, &st);
+        return;
+    }
+    
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "Error: Cannot open directory %s\n", path);
+        return;
+    }
+    
+    size_t path_length = strlen(path);
+    bool has_separator = path_length > 0 && (path[path_length - 1] == '/' || path[path_length - 1] == '\\');
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        
+        char child[MAX_PATH];
+        int length = snprintf(child, sizeof(child), "%s%s%s", path, has_separator ? "" : "/", entry->d_name);
+        if (length < 0 || length >= (int)sizeof(child)) {
+            fprintf(stderr, "Error: Path too long in %s\n", path);
+            continue;
+        }
+        
+        #ifndef _WIN32
+        if (lstat(child, &st) != 0 || S_ISLNK(st.st_mode)) continue;
+        #else
+        if (stat(child, &st) != 0) continue;
+        #endif
+        
+        if (S_ISDIR(st.st_mode)) {
+            collect_markdown_files(child, list);
+        } else if (S_ISREG(st.st_mode) && has_markdown_extension(entry->d_name)) {
+            path_list_add_file(list, child, &st);
+        }
+    }
+    
+    closedir(dir);
+}
+
+// 获取CPU核心数，用于确定工作线程数量
+int detect_cpu_count() {
+    #ifdef _WIN32
+    const char* value = getenv("NUMBER_OF_PROCESSORS");
+    int count = value != NULL ? atoi(value) : 1;
+    #else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    #endif
+    return count > 0 ? count : 1;
+}
+
+// 转换单个Markdown文件，结果写到源文件旁的*_mindmap.txt
+bool convert_markdown_file(ParserContext* ctx, const char* filename, int max_level, OutputFormat format) {
+    char output_filename[MAX_PATH];
+    
+    STATS_BEGIN(&ctx->stats, timer, PHASE_OTHER);
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        STATS_END(&ctx->stats, timer);
+        return false;
+    }
+    
+    generate_output_filename(filename, output_filename);
+    set_output_extension(output_filename, format);
+    
+    FILE* output_file = fopen(output_filename, format == FORMAT_TEXT ? "w" : "wb");
+    if (output_file == NULL) {
+        fprintf(stderr, "Error: Cannot create output file %s\n", output_filename);
+        fclose(file);
+        STATS_END(&ctx->stats, timer);
+        return false;
+    }
+    
+    // 文本格式一次性转换，使用融合解析渲染，不建树
+    OutputBuffer buffer;
+    output_init(&buffer, output_file);
+    buffer.stats = &ctx->stats;
+    bool ok;
+    if (format == FORMAT_TEXT) {
+        write_mind_map_header(output_file, filename, max_level);
+        ok = render_markdown_file_fused(ctx, file, max_level, &buffer);
+        output_flush(&buffer);
+        write_mind_map_footer(output_file);
+    } else {
+        ok = parse_markdown_file(ctx, file, max_level);
+        if (ok) ok = render_mind_map_body(ctx, format, &buffer);
+        output_flush(&buffer);
+    }
+    output_free(&buffer);
+    
+    fclose(file);
+    if (fclose(output_file) != 0) ok = false;
+    // 不完整的输出文件不保留
+    if (!ok) remove(output_filename);
+    free_tree(ctx);
+    STATS_END(&ctx->stats, timer);
+    return ok;
+}
+
+// 修改时间的纳秒部分，平台不提供时为0
+long long stat_mtime_nsec(const struct stat* st) {
+    #if defined(_WIN32)
+    (void)st;
+    return 0;
+    #elif defined(__APPLE__)
+    return (long long)st->st_mtimespec.tv_nsec;
+    #else
+    return (long long)st->st_mtim.tv_nsec;
+    #endif
+}
+
+// 判断文件状态与条目记录的是否相同，可以不读内容直接跳过
+// 记录时修改时间不早于读取时间的条目不算：之后同一秒内的写入可能让大小和修改时间都不变
+bool cache_entry_unchanged(const CacheEntry* entry, const struct stat* st) {
+    return entry->size == (long long)st->st_size && entry->mtime == (long long)st->st_mtime &&
+           entry->mtime_nsec == stat_mtime_nsec(st) && entry->ctime == (long long)st->st_ctime &&
+           entry->inode == (long long)st->st_ino && entry->mtime < entry->checked;
+}
+
+// 把文件状态记入条目，checked为读取文件前的时间
+void cache_entry_record(CacheEntry* entry, const struct stat* st, long long checked) {
+    entry->size = (long long)st->st_size;
+    entry->mtime = (long long)st->st_mtime;
+    entry->mtime_nsec = stat_mtime_nsec(st);
+    entry->ctime = (long long)st->st_ctime;
+    entry->inode = (long long)st->st_ino;
+    entry->checked = checked;
+}
+
+// 初始化空的缓存清单（不关联目录），可单独用作按路径查找的文件状态表
+void cache_init(MindMapCache* cache) {
+    cache->directory[0] = '\0';
+    cache->entries = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->slot_count = CACHE_TABLE_INITIAL;
+    cache->slots = (int*)malloc((size_t)cache->slot_count * sizeof(int));
+    if (cache->slots == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    for (int i = 0; i < cache->slot_count; i++) {
+        cache->slots[i] = -1;
+    }
+}
+
+// 打开缓存目录（不存在时创建）并读入清单，清单版本、渲染版本或格式不符的清单整个忽略
+// 同一输入的输出一旦改变（解析规则或渲染格式变化），需增加RENDER_VERSION使旧的缓存结果和清单失效
+bool cache_open(MindMapCache* cache, const char* directory) {
+    cache_init(cache);
+    
+    if (strlen(directory) >= sizeof(cache->directory)) {
+        fprintf(stderr, "Error: Cache directory path too long\n");
+        return false;
+    }
+    strcpy(cache->directory, directory);
+    
+    #ifdef _WIN32
+    _mkdir(directory);
+    #else
+    mkdir(directory, 0755);
+    #endif
+    
+    struct stat st;
+    if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Error: Cannot create cache directory %s\n", directory);
+        return false;
+    }
+    
+    char manifest_path[MAX_PATH + 64];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", directory, CACHE_MANIFEST);
+    FILE* manifest = fopen(manifest_path, "r");
+    if (manifest == NULL) {
+        return true;
+    }
+    
+    char line[MAX_PATH + 128];
+    char expected[64];
+    snprintf(expected, sizeof(expected), "MtMT-cache %d %d\n", CACHE_VERSION, RENDER_VERSION);
+    if (fgets(line, sizeof(line), manifest) != NULL && strcmp(line, expected) == 0) {
+        // 每行：内容哈希 大小 修改时间 纳秒 状态改变时间 inode 读取时间 级别 格式 编码 路径
+        while (fgets(line, sizeof(line), manifest) != NULL) {
+            unsigned long long hash;
+            long long size, mtime, mtime_nsec, ctime, inode, checked;
+            int max_level, consumed;
+            char format_name[16];
+            char encoding_name[16];
+            OutputFormat format;
+            TextEncoding encoding;
+            if (sscanf(line, "%llx %lld %lld %lld %lld %lld %lld %d %15s %15s %n", &hash, &size, &mtime, &mtime_nsec,
+                       &ctime, &inode, &checked, &max_level, format_name, encoding_name, &consumed) != 10) continue;
+            if (!parse_output_format(format_name, &format) || !parse_encoding_name(encoding_name, &encoding)) continue;
+            
+            char* path = line + consumed;
+            path[strcspn(path, "\r\n")] = '\0';
+            if (path[0] == '\0') continue;
+            
+            int index = cache_find_or_add(cache, path);
+            CacheEntry* entry = &cache->entries[index];
+            entry->hash = hash;
+            entry->size = size;
+            entry->mtime = mtime;
+            entry->mtime_nsec = mtime_nsec;
+            entry->ctime = ctime;
+            entry->inode = inode;
+            entry->checked = checked;
+            entry->max_level = max_level;
+            entry->format = format;
+            entry->encoding = encoding;
+        }
+    }
+    
+    fclose(manifest);
+    return true;
+}
+
+// 按路径查找清单条目，不存在时新建一个空条目，返回条目下标
+// 只在启动工作线程之前调用，哈希表按需扩容
+int cache_find_or_add(MindMapCache* cache, const char* path) {
+    size_t length = strlen(path);
+    int mask = cache->slot_count - 1;
+    int slot = (int)(hash_bytes(path, length, 0) & (uint64_t)mask);
+    
+    while (cache->slots[slot] >= 0) {
+        if (strcmp(cache->entries[cache->slots[slot]].path, path) == 0) {
+            return cache->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    if (cache->count == cache->capacity) {
+        int capacity = cache->capacity > 0 ? cache->capacity * 2 : CACHE_TABLE_INITIAL;
+        CacheEntry* entries = (CacheEntry*)realloc(cache->entries, (size_t)capacity * sizeof(CacheEntry));
+        if (entries == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    
+    CacheEntry* entry = &cache->entries[cache->count];
+    entry->path = (char*)malloc(length + 1);
+    if (entry->path == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    memcpy(entry->path, path, length + 1);
+    entry->size = -1;
+    entry->mtime = -1;
+    entry->mtime_nsec = 0;
+    entry->ctime = 0;
+    entry->inode = 0;
+    entry->checked = 0;
+    entry->hash = 0;
+    entry->max_level = 0;
+    entry->format = FORMAT_TEXT;
+    entry->encoding = ENCODING_AUTO;
+    cache->slots[slot] = cache->count++;
+    
+    // 装载率超过一半时加倍并重新插入
+    if (cache->count * 2 > cache->slot_count) {
+        int slot_count = cache->slot_count * 2;
+        int* slots = (int*)malloc((size_t)slot_count * sizeof(int));
+        if (slots == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        for (int i = 0; i < slot_count; i++) {
+            slots[i] = -1;
+        }
+        for (int i = 0; i < cache->count; i++) {
+            const char* key = cache->entries[i].path;
+            int s = (int)(hash_bytes(key, strlen(key), 0) & (uint64_t)(slot_count - 1));
+            while (slots[s] >= 0) s = (s + 1) & (slot_count - 1);
+            slots[s] = i;
+        }
+        free(cache->slots);
+        cache->slots = slots;
+        cache->slot_count = slot_count;
+    }
+    
+    return cache->count - 1;
+}
+
+// 写回清单 - 先写临时文件再改名，中途失败不会留下损坏的清单
+bool cache_save(const MindMapCache* cache) {
+    char manifest_path[MAX_PATH + 64];
+    char temp_path[MAX_PATH + 96];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", cache->directory, CACHE_MANIFEST);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", manifest_path);
+    
+    FILE* manifest = fopen(temp_path, "w");
+    if (manifest == NULL) {
+        fprintf(stderr, "Error: Cannot write cache manifest %s\n", temp_path);
+        return false;
+    }
+    
+    fprintf(manifest, "MtMT-cache %d %d\n", CACHE_VERSION, RENDER_VERSION);
+    for (int i = 0; i < cache->count; i++) {
+        const CacheEntry* entry = &cache->entries[i];
+        if (entry->size < 0) continue;
+        fprintf(manifest, "%016llx %lld %lld %lld %lld %lld %lld %d %s %s %s\n", (unsigned long long)entry->hash,
+                entry->size, entry->mtime, entry->mtime_nsec, entry->ctime, entry->inode, entry->checked,
+                entry->max_level, format_extension((OutputFormat)entry->format),
+                encoding_name((TextEncoding)entry->encoding), entry->path);
+    }
+    
+    bool ok = fclose(manifest) == 0;
+    #ifdef _WIN32
+    remove(manifest_path);
+    #endif
+    if (!ok || rename(temp_path, manifest_path) != 0) {
+        fprintf(stderr, "Error: Cannot write cache manifest %s\n", manifest_path);
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+// 释放缓存清单
+void cache_close(MindMapCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        free(cache->entries[i].path);
+    }
+    free(cache->entries);
+    free(cache->slots);
+    cache->entries = NULL;
+    cache->slots = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+}
+
+// 带缓存的转换 - 输入的大小和修改时间与清单一致且输出文件还在时直接跳过（只需stat）
+// 否则读入并计算内容哈希，缓存中已有相同内容的渲染结果时直接复制，没有时解析后写入缓存
+ConvertResult convert_markdown_file_cached(ParserContext* ctx, const char* filename, int max_level, OutputFormat format, const MindMapCache* cache, CacheEntry* entry) {
+    char output_filename[MAX_PATH];
+    generate_output_filename(filename, output_filename);
+    set_output_extension(output_filename, format);
+    
+    // 读取时间在stat之前取得，之后的写入不会早于它
+    long long checked = (long long)time(NULL);
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return CONVERT_FAILED;
+    }
+    
+    struct stat output_st;
+    if (cache_entry_unchanged(entry, &st) &&
+        entry->max_level == max_level && entry->format == (int)format && entry->encoding == (int)ctx->encoding &&
+        stat(output_filename, &output_st) == 0) {
+        return CONVERT_SKIPPED;
+    }
+    
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return CONVERT_FAILED;
+    }
+    
+    STATS_BEGIN(&ctx->stats, timer, PHASE_OTHER);
+    InputBuffer input;
+    STATS_BEGIN(&ctx->stats, read_timer, PHASE_READ);
+    bool loaded = load_input(file, &input);
+    STATS_END(&ctx->stats, read_timer);
+    fclose(file);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input %s\n", filename);
+        STATS_END(&ctx->stats, timer);
+        return CONVERT_FAILED;
+    }
+    STATS_ADD(&ctx->stats, bytes_read, input.size);
+    
+    // 缓存键是原始字节的哈希，以渲染版本和指定的编码为种子：解析规则改变后旧结果不再命中，指定编码与自动检测的结果互不混用
+    uint64_t hash = hash_bytes(input.data, input.size, ((uint64_t)RENDER_VERSION << 8) | (uint64_t)ctx->encoding);
+    
+    char cache_path[MAX_PATH + 64];
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx-L%d.%s", cache->directory,
+             (unsigned long long)hash, max_level, format_extension(format));
+    
+    // 先查缓存，命中时不解析
+    ConvertResult result = CONVERT_CACHED;
+    InputBuffer body;
+    body.data = NULL;
+    FILE* cached = fopen(cache_path, "rb");
+    if (cached != NULL) {
+        if (!load_input(cached, &body)) body.data = NULL;
+        fclose(cached);
+    }
+    
+    OutputBuffer rendered;
+    output_init(&rendered, NULL);
+    rendered.stats = &ctx->stats;
+    
+    if (body.data == NULL) {
+        result = CONVERT_PARSED;
+        STATS_BEGIN(&ctx->stats, decode_timer, PHASE_DECODE);
+        decode_input(&input, ctx->encoding);
+        STATS_END(&ctx->stats, decode_timer);
+        bool ok;
+        if (format == FORMAT_TEXT) {
+            ok = render_markdown_fused(ctx, input.data, input.size, max_level, &rendered);
+        } else {
+            parse_markdown_buffer(ctx, input.data, input.size, max_level);
+            ok = render_mind_map_body(ctx, format, &rendered);
+            free_tree(ctx);
+        }
+        
+        // 标题超出上限时结果不完整，不写缓存也不生成输出文件
+        if (!ok) {
+            release_input(&input);
+            output_free(&rendered);
+            STATS_END(&ctx->stats, timer);
+            return CONVERT_FAILED;
+        }
+        
+        // 写临时文件后改名，多个线程同时写同一内容时互不干扰
+        char temp_path[MAX_PATH + 96];
+        snprintf(temp_path, sizeof(temp_path), "%s.%lx.tmp", cache_path, (unsigned long)(uintptr_t)ctx);
+        FILE* temp = fopen(temp_path, "wb");
+        if (temp != NULL) {
+            bool written = fwrite(rendered.data, 1, rendered.length, temp) == rendered.length;
+            written = fclose(temp) == 0 && written;
+            if (!written || rename(temp_path, cache_path) != 0) {
+                remove(temp_path);
+            }
+        }
+    }
+    release_input(&input);
+    
+    ConvertResult status = result;
+    FILE* output_file = fopen(output_filename, format == FORMAT_TEXT ? "w" : "wb");
+    if (output_file == NULL) {
+        fprintf(stderr, "Error: Cannot create output file %s\n", output_filename);
+        status = CONVERT_FAILED;
+    } else {
+        if (format == FORMAT_TEXT) write_mind_map_header(output_file, filename, max_level);
+        rendered.file = output_file;
+        if (result == CONVERT_CACHED) {
+            output_emit(&rendered, body.data, body.size);
+        } else {
+            output_emit(&rendered, rendered.data, rendered.length);
+        }
+        if (format == FORMAT_TEXT) write_mind_map_footer(output_file);
+        if (fclose(output_file) != 0) status = CONVERT_FAILED;
+    }
+    
+    if (body.data != NULL) release_input(&body);
+    output_free(&rendered);
+    STATS_END(&ctx->stats, timer);
+    
+    if (status != CONVERT_FAILED) {
+        cache_entry_record(entry, &st, checked);
+        entry->hash = hash;
+        entry->max_level = max_level;
+        entry->format = (int)format;
+        entry->encoding = (int)ctx->encoding;
+    }
+    return status;
+}
+
+// 批处理工作线程 - 使用自己的解析上下文循环领取文件并转换
+void* batch_worker(void* arg) {
+    BatchJob* job = (BatchJob*)arg;
+    ParserContext* ctx = create_parser_context();
+    ctx->threads = job->parse_threads;
+    ctx->encoding = job->encoding;
+    ctx->stats.enabled = job->stats.enabled;
+    int failed = 0;
+    int cached = 0;
+    int skipped = 0;
+    
+    while (1) {
+        pthread_mutex_lock(&job->mutex);
+        int index = job->next_index++;
+        pthread_mutex_unlock(&job->mutex);
+        
+        if (index >= job->files->count) break;
+        
+        if (job->cache == NULL) {
+            if (!convert_markdown_file(ctx, job->files->items[index], job->max_level, job->format)) {
+                failed++;
+            }
+            continue;
+        }
+        
+        CacheEntry* entry = &job->cache->entries[job->cache_entries[index]];
+        switch (convert_markdown_file_cached(ctx, job->files->items[index], job->max_level, job->format, job->cache, entry)) {
+            case CONVERT_FAILED: failed++; break;
+            case CONVERT_CACHED: cached++; break;
+            case CONVERT_SKIPPED: skipped++; break;
+            case CONVERT_PARSED: break;
+        }
+    }
+    
+    pthread_mutex_lock(&job->mutex);
+    job->failed += failed;
+    job->cached += cached;
+    job->skipped += skipped;
+    if (job->stats.enabled) stats_merge(&job->stats, &ctx->stats);
+    pthread_mutex_unlock(&job->mutex);
+    
+    free_parser_context(ctx);
+    return NULL;
+}
+
+// 批处理模式 - 参数为目录、文件或通配符，用与CPU核心数相同的线程并行转换
+int run_batch(int argc, char* argv[]) {
+    int max_level = MAX_LEVEL;
+    int jobs = detect_cpu_count();
+    const char* cache_directory = NULL;
+    OutputFormat format = FORMAT_TEXT;
+    TextEncoding encoding = ENCODING_AUTO;
+    bool stats = false;
+    PathList files = { NULL, 0, 0 };
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            max_level = atoi(argv[++i]);
+            if (max_level < 1 || max_level > MAX_LEVEL) {
+                printf("Error: Level must be between 1-%d\n", MAX_LEVEL);
+                path_list_free(&files);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) jobs = 1;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_directory = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!parse_output_format(argv[++i], &format)) {
+                printf("Error: Unknown format %s (use txt, bin, json or opml)\n", argv[i]);
+                path_list_free(&files);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+            if (!parse_encoding_name(argv[++i], &encoding)) {
+                printf("Error: Unknown encoding %s (use auto, utf8 or gbk)\n", argv[i]);
+                path_list_free(&files);
+                return 1;
+            }
+        } else if (parse_stats_flag(argv[i])) {
+            stats = true;
+        } else {
+            #ifndef _WIN32
+            // shell未展开的通配符（例如加了引号）在这里展开
+            glob_t matches;
+            if (strpbrk(argv[i], "*?[") != NULL && glob(argv[i], 0, NULL, &matches) == 0) {
+                for (size_t j = 0; j < matches.gl_pathc; j++) {
+                    collect_markdown_files(matches.gl_pathv[j], &files);
+                }
+                globfree(&matches);
+                continue;
+            }
+            #endif
+            collect_markdown_files(argv[i], &files);
+        }
+    }
+    
+    if (files.count == 0) {
+        printf("No Markdown files found\n");
+        path_list_free(&files);
+        return 1;
+    }
+    
+    if (jobs > files.count) jobs = files.count;
+    
+    double start = now_seconds();
+    
+    BatchJob job;
+    job.files = &files;
+    job.max_level = max_level;
+    job.format = format;
+    job.encoding = encoding;
+    // 文件数少于核心数时，空闲的核心用于单个大文件的分块解析
+    job.parse_threads = detect_cpu_count() / jobs;
+    if (job.parse_threads < 1) job.parse_threads = 1;
+    job.next_index = 0;
+    job.failed = 0;
+    job.cached = 0;
+    job.skipped = 0;
+    job.cache = NULL;
+    job.cache_entries = NULL;
+    job.stats.enabled = stats;
+    stats_reset(&job.stats);
+    
+    // 工作线程启动前为每个文件准备好清单条目
+    MindMapCache cache;
+    if (cache_directory != NULL) {
+        if (!cache_open(&cache, cache_directory)) {
+            cache_close(&cache);
+            path_list_free(&files);
+            return 1;
+        }
+        job.cache = &cache;
+        job.cache_entries = (int*)malloc((size_t)files.count * sizeof(int));
+        if (job.cache_entries == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        for (int i = 0; i < files.count; i++) {
+            job.cache_entries[i] = cache_find_or_add(&cache, files.items[i]);
+        }
+    }
+    
+    pthread_mutex_init(&job.mutex, NULL);
+    
+    pthread_t* threads = (pthread_t*)malloc((size_t)jobs * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &job) == 0) {
+            started++;
+        }
+    }
+    
+    // 线程创建失败时由主线程完成剩余工作
+    if (started == 0) {
+        batch_worker(&job);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    int status = job.failed > 0 ? 1 : 0;
+    if (job.cache != NULL) {
+        if (!cache_save(&cache)) status = 1;
+        free(job.cache_entries);
+        cache_close(&cache);
+    }
+    
+    double elapsed = now_seconds() - start;
+    printf("Processed %d files (%d failed) with %d threads in %.2f s\n",
+           files.count, job.failed, started > 0 ? started : 1, elapsed);
+    if (job.cache != NULL) {
+        printf("Cache: %d unchanged, %d served from cache, %d parsed\n",
+               job.skipped, job.cached, files.count - job.failed - job.skipped - job.cached);
+    }
+    if (stats) {
+        OutputBuffer json;
+        output_init(&json, stdout);
+        output_puts(&json, "Stats: ");
+        render_stats_json(&job.stats, NULL, max_level, &json);
+        output_puts(&json, "\n");
+        output_flush(&json);
+        output_free(&json);
+    }
+    
+    pthread_mutex_destroy(&job.mutex);
+    free(threads);
+    path_list_free(&files);
+    return status;
+}
+
+// 打印二进制思维导图 - 映射文件后直接在其上渲染文本
+int show_binary_mind_map(const char* filename) {
+    MindMapView view;
+    if (!open_mind_map_view(filename, &view)) {
+        return 1;
+    }
+    if (!verify_mind_map_view(&view)) {
+        fprintf(stderr, "Error: Binary mind map %s is truncated or corrupted\n", filename);
+        close_mind_map_view(&view);
+        return 1;
+    }
+    
+    print_flat_mind_map(&view.map, view.max_level, stdout);
+    close_mind_map_view(&view);
+    return 0;
+}
+
+// 忽略ASCII大小写时使用的字节 - 只折叠A-Z，UTF-8多字节字符按原始字节比较
+unsigned char fold_ascii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+// 忽略大小写后的前8字节按大端拼成整数，不足8字节补0，整数大小顺序与字典序一致
+uint64_t folded_prefix(const char* text) {
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = *text != '\0' ? fold_ascii((unsigned char)*text++) : 0;
+        prefix = (prefix << 8) | c;
+    }
+    return prefix;
+}
+
+// 忽略ASCII大小写比较两个标题，相同时再按原始字节比较，大小写不同的标题也有确定的顺序
+int compare_folded(const char* a, const char* b) {
+    const unsigned char* x = (const unsigned char*)a;
+    const unsigned char* y = (const unsigned char*)b;
+    while (*x != '\0' && fold_ascii(*x) == fold_ascii(*y)) {
+        x++;
+        y++;
+    }
+    int diff = (int)fold_ascii(*x) - (int)fold_ascii(*y);
+    return diff != 0 ? diff : strcmp(a, b);
+}
+
+// 标题与已折叠的查询串比较前length字节，返回0表示标题以查询串开头（忽略大小写）
+int compare_folded_prefix(const char* text, const char* query, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        int diff = (int)fold_ascii((unsigned char)text[i]) - (int)(unsigned char)query[i];
+        if (diff != 0) return diff;
+    }
+    return 0;
+}
+
+// 建索引时的排序顺序 - 先按标题（忽略大小写），再按文件编号和行号
+int compare_index_entries(const void* a, const void* b) {
+    const IndexEntry* x = (const IndexEntry*)a;
+    const IndexEntry* y = (const IndexEntry*)b;
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    int order = compare_folded(x->title, y->title);
+    if (order != 0) return order;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    return (x->line_number > y->line_number) - (x->line_number < y->line_number);
+}
+
+// 32位无符号整数升序
+int compare_uint32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 取出文本中不重复的三元组（连续3字节，忽略大小写），按值升序写入trigrams并返回个数
+// trigrams至少能容纳length个元素；标题大多很短，用插入排序
+int unique_trigrams(const char* text, size_t length, uint32_t* trigrams) {
+    if (length < 3) return 0;
+    
+    const unsigned char* bytes = (const unsigned char*)text;
+    uint32_t window = ((uint32_t)fold_ascii(bytes[0]) << 8) | fold_ascii(bytes[1]);
+    int count = 0;
+    for (size_t i = 2; i < length; i++) {
+        window = ((window << 8) | fold_ascii(bytes[i])) & (TRIGRAM_SPACE - 1);
+        trigrams[count++] = window;
+    }
+    
+    if (count > TRIGRAM_SORT_SMALL) {
+        qsort(trigrams, (size_t)count, sizeof(uint32_t), compare_uint32);
+    } else {
+        for (int i = 1; i < count; i++) {
+            uint32_t value = trigrams[i];
+            int j = i;
+            while (j > 0 && trigrams[j - 1] > value) {
+                trigrams[j] = trigrams[j - 1];
+                j--;
+            }
+            trigrams[j] = value;
+        }
+    }
+    
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || trigrams[unique - 1] != trigrams[i]) {
+            trigrams[unique++] = trigrams[i];
+        }
+    }
+    return unique;
+}
+
+// 为工作线程开始一个新的空段
+IndexSegment* index_worker_add_segment(IndexWorker* worker) {
+    if (worker->segment_count == worker->segment_capacity) {
+        int capacity = worker->segment_capacity > 0 ? worker->segment_capacity * 2 : 4;
+        IndexSegment* segments = (IndexSegment*)realloc(worker->segments, (size_t)capacity * sizeof(IndexSegment));
+        if (segments == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        worker->segments = segments;
+        worker->segment_capacity = capacity;
+    }
+    
+    IndexSegment* segment = &worker->segments[worker->segment_count++];
+    flat_mind_map_init(&segment->map);
+    segment->files = NULL;
+    segment->file_capacity = 0;
+    return segment;
+}
+
+// 把上下文中一个文件的全部标题追加到段中 - 字符串池放不下时已追加的部分撤回并返回false
+bool index_segment_add_file(IndexSegment* segment, const ParserContext* ctx, uint32_t file) {
+    FlatMindMap* map = &segment->map;
+    int first = map->count;
+    size_t first_pool_size = map->pool_size;
+    for (int i = 0; i < ctx->headings.count; i++) {
+        HeadingNode* node = ctx->headings.items[i];
+        if (!flat_mind_map_append(map, node->level, node->line_number, node->text, strlen(node->text))) {
+            map->count = first;
+            map->pool_size = first_pool_size;
+            return false;
+        }
+    }
+    
+    if (segment->file_capacity < map->capacity) {
+        uint32_t* files = (uint32_t*)realloc(segment->files, (size_t)map->capacity * sizeof(uint32_t));
+        if (files == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        segment->files = files;
+        segment->file_capacity = map->capacity;
+    }
+    for (int i = first; i < map->count; i++) {
+        segment->files[i] = file;
+    }
+    return true;
+}
+
+// 释放工作线程的全部段
+void free_index_worker(IndexWorker* worker) {
+    for (int i = 0; i < worker->segment_count; i++) {
+        free_flat_mind_map(&worker->segments[i].map);
+        free(worker->segments[i].files);
+    }
+    free(worker->segments);
+    worker->segments = NULL;
+    worker->segment_count = 0;
+    worker->segment_capacity = 0;
+}
+
+// 建索引工作线程 - 逐个解析文件，按文档顺序把标题追加到自己的段
+void* index_worker(void* arg) {
+    IndexWorker* worker = (IndexWorker*)arg;
+    IndexJob* job = worker->job;
+    ParserContext* ctx = create_parser_context();
+    ctx->threads = job->parse_threads;
+    ctx->encoding = job->encoding;
+    int failed = 0;
+    
+    while (1) {
+        pthread_mutex_lock(&job->mutex);
+        int index = job->next_index++;
+        pthread_mutex_unlock(&job->mutex);
+        
+        if (index >= job->files->count) break;
+        
+        FILE* file = fopen(job->files->items[index], "r");
+        if (file == NULL) {
+            fprintf(stderr, "Error: Cannot open file %s\n", job->files->items[index]);
+            failed++;
+            continue;
+        }
+        if (!parse_markdown_file(ctx, file, job->max_level)) failed++;
+        fclose(file);
+        
+        // 当前段放不下这个文件的全部标题时换新段；只有一个文件的标题就超过上限时才算失败
+        size_t needed = 0;
+        for (int i = 0; i < ctx->headings.count; i++) {
+            needed += strlen(ctx->headings.items[i]->text) + 1;
+        }
+        IndexSegment* segment = worker->segment_count > 0 ? &worker->segments[worker->segment_count - 1] : NULL;
+        if (segment == NULL || (segment->map.count > 0 && (uint64_t)segment->map.pool_size + needed > UINT32_MAX)) {
+            segment = index_worker_add_segment(worker);
+        }
+        if (!index_segment_add_file(segment, ctx, (uint32_t)index)) {
+            fprintf(stderr, "Error: Cannot index %s\n", job->files->items[index]);
+            failed++;
+        }
+        free_tree(ctx);
+    }
+    
+    pthread_mutex_lock(&job->mutex);
+    job->failed += failed;
+    pthread_mutex_unlock(&job->mutex);
+    
+    free_parser_context(ctx);
+    return NULL;
+}
+
+// 写出标题搜索索引 - 所有标题按忽略大小写的顺序排序，相同的标题合并为一个key只保存一次，再为key的三元组建倒排表
+// 先写到临时文件，完成后改名，查询不会读到写了一半的索引
+bool write_search_index(const char* path, const IndexWorker* workers, int worker_count, const PathList* files, int max_level, uint64_t* index_size) {
+    size_t count = 0;
+    size_t pool_limit = 1;
+    for (int w = 0; w < worker_count; w++) {
+        for (int g = 0; g < workers[w].segment_count; g++) {
+            count += (size_t)workers[w].segments[g].map.count;
+            pool_limit += workers[w].segments[g].map.pool_size;
+        }
+    }
+    size_t path_pool_size = 0;
+    for (int i = 0; i < files->count; i++) {
+        path_pool_size += strlen(files->items[i]) + 1;
+    }
+    // 偏移和编号都是32位；标题池只存放去重后的标题，在去重时检查
+    if (count >= UINT32_MAX || path_pool_size >= UINT32_MAX) {
+        fprintf(stderr, "Error: Too many headings for one index\n");
+        return false;
+    }
+    
+    IndexEntry* entries = (IndexEntry*)malloc((count + 1) * sizeof(IndexEntry));
+    uint32_t* key_offsets = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    uint32_t* key_first = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    uint32_t* heading_files = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    int* heading_lines = (int*)malloc((count + 1) * sizeof(int));
+    uint8_t* heading_levels = (uint8_t*)malloc(count + 1);
+    char* title_pool = (char*)malloc(pool_limit);
+    uint32_t* first = (uint32_t*)calloc((size_t)TRIGRAM_SPACE + 2, sizeof(uint32_t));
+    if (entries == NULL || key_offsets == NULL || key_first == NULL || heading_files == NULL ||
+        heading_lines == NULL || heading_levels == NULL || title_pool == NULL || first == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    size_t n = 0;
+    for (int w = 0; w < worker_count; w++) {
+        for (int g = 0; g < workers[w].segment_count; g++) {
+            const IndexSegment* segment = &workers[w].segments[g];
+            const FlatMindMap* map = &segment->map;
+            for (int i = 0; i < map->count; i++) {
+                IndexEntry* entry = &entries[n++];
+                entry->title = map->title_pool + map->title_offsets[i];
+                entry->prefix = folded_prefix(entry->title);
+                entry->file = segment->files[i];
+                entry->line_number = map->line_numbers[i];
+                entry->level = map->levels[i];
+            }
+        }
+    }
+    qsort(entries, count, sizeof(IndexEntry), compare_index_entries);
+    
+    // 排序后相同的标题相邻
+    uint32_t key_count = 0;
+    size_t title_pool_size = 0;
+    size_t longest = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || strcmp(entries[i].title, entries[i - 1].title) != 0) {
+            size_t length = strlen(entries[i].title);
+            if ((uint64_t)title_pool_size + length + 1 > UINT32_MAX) {
+                fprintf(stderr, "Error: Too many distinct heading titles for one index\n");
+                free(entries);
+                free(key_offsets);
+                free(key_first);
+                free(heading_files);
+                free(heading_lines);
+                free(heading_levels);
+                free(title_pool);
+                free(first);
+                return false;
+            }
+            key_offsets[key_count] = (uint32_t)title_pool_size;
+            key_first[key_count] = (uint32_t)i;
+            key_count++;
+            memcpy(title_pool + title_pool_size, entries[i].title, length + 1);
+            title_pool_size += length + 1;
+            if (length > longest) longest = length;
+        }
+        heading_files[i] = entries[i].file;
+        heading_lines[i] = entries[i].line_number;
+        heading_levels[i] = (uint8_t)entries[i].level;
+    }
+    key_first[key_count] = (uint32_t)count;
+    free(entries);
+    
+    // 三元组倒排表 - 先统计每个三元组出现在多少个key中，计数放在first[t + 2]；前缀和之后first[t + 1]是t的起点，
+    // 按key编号顺序填入时后移，填完恰好是t + 1的起点，同一三元组的key编号自然升序
+    uint32_t* trigrams = (uint32_t*)malloc((longest + 1) * sizeof(uint32_t));
+    if (trigrams == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    size_t posting_count = 0;
+    for (uint32_t k = 0; k < key_count; k++) {
+        size_t end = k + 1 < key_count ? key_offsets[k + 1] : title_pool_size;
+        int found = unique_trigrams(title_pool + key_offsets[k], end - key_offsets[k] - 1, trigrams);
+        for (int j = 0; j < found; j++) {
+            first[trigrams[j] + 2]++;
+        }
+        posting_count += (size_t)found;
+    }
+    for (size_t t = 2; t < (size_t)TRIGRAM_SPACE + 2; t++) {
+        first[t] += first[t - 1];
+    }
+    
+    uint32_t* postings = (uint32_t*)malloc((posting_count + 1) * sizeof(uint32_t));
+    if (postings == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    for (uint32_t k = 0; k < key_count; k++) {
+        size_t end = k + 1 < key_count ? key_offsets[k + 1] : title_pool_size;
+        int found = unique_trigrams(title_pool + key_offsets[k], end - key_offsets[k] - 1, trigrams);
+        for (int j = 0; j < found; j++) {
+            postings[first[trigrams[j] + 1]++] = k;
+        }
+    }
+    free(trigrams);
+    
+    // 只保留出现过的三元组
+    uint32_t trigram_count = 0;
+    for (uint32_t t = 0; t < TRIGRAM_SPACE; t++) {
+        if (first[t + 1] > first[t]) trigram_count++;
+    }
+    uint32_t* trigram_values = (uint32_t*)malloc(((size_t)trigram_count + 1) * sizeof(uint32_t));
+    uint32_t* trigram_first = (uint32_t*)malloc(((size_t)trigram_count + 1) * sizeof(uint32_t));
+    if (trigram_values == NULL || trigram_first == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    uint32_t used = 0;
+    for (uint32_t t = 0; t < TRIGRAM_SPACE; t++) {
+        if (first[t + 1] > first[t]) {
+            trigram_values[used] = t;
+            trigram_first[used] = first[t];
+            used++;
+        }
+    }
+    trigram_first[trigram_count] = (uint32_t)posting_count;
+    free(first);
+    
+    SearchIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, 4);
+    header.version = SEARCH_INDEX_VERSION;
+    header.max_level = (uint8_t)max_level;
+    header.byte_order = BINARY_BYTE_ORDER;
+    header.file_count = (uint32_t)files->count;
+    header.key_count = key_count;
+    header.heading_count = (uint32_t)count;
+    header.trigram_count = trigram_count;
+    header.posting_count = (uint32_t)posting_count;
+    header.path_pool_size = path_pool_size;
+    header.title_pool_size = title_pool_size;
+    
+    char temp_path[MAX_PATH + 16];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* file = fopen(temp_path, "wb");
+    bool ok = file != NULL;
+    if (ok) {
+        OutputBuffer output;
+        output_init(&output, file);
+        output_write(&output, (const char*)&header, sizeof(header));
+        uint32_t offset = 0;
+        for (int i = 0; i < files->count; i++) {
+            output_write(&output, (const char*)&offset, sizeof(uint32_t));
+            offset += (uint32_t)strlen(files->items[i]) + 1;
+        }
+        output_write(&output, (const char*)key_offsets, (size_t)key_count * sizeof(uint32_t));
+        output_write(&output, (const char*)key_first, ((size_t)key_count + 1) * sizeof(uint32_t));
+        output_write(&output, (const char*)heading_files, count * sizeof(uint32_t));
+        output_write(&output, (const char*)heading_lines, count * sizeof(int));
+        output_write(&output, (const char*)trigram_values, (size_t)trigram_count * sizeof(uint32_t));
+        output_write(&output, (const char*)trigram_first, ((size_t)trigram_count + 1) * sizeof(uint32_t));
+        output_write(&output, (const char*)postings, posting_count * sizeof(uint32_t));
+        output_write(&output, (const char*)heading_levels, count);
+        for (int i = 0; i < files->count; i++) {
+            output_write(&output, files->items[i], strlen(files->items[i]) + 1);
+        }
+        output_write(&output, title_pool, title_pool_size);
+        output_flush(&output);
+        output_free(&output);
+        
+        if (ferror(file)) ok = false;
+        if (fclose(file) != 0) ok = false;
+        #ifdef _WIN32
+        if (ok) remove(path);
+        #endif
+        if (!ok || rename(temp_path, path) != 0) {
+            ok = false;
+            remove(temp_path);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot write index %s\n", path);
+    }
+    
+    *index_size = sizeof(header) + ((uint64_t)files->count + 2 * (uint64_t)key_count + 1 + 2 * (uint64_t)count +
+                  2 * (uint64_t)trigram_count + 1 + posting_count) * sizeof(uint32_t) + count + path_pool_size + title_pool_size;
+    
+    free(key_offsets);
+    free(key_first);
+    free(heading_files);
+    free(heading_lines);
+    free(heading_levels);
+    free(title_pool);
+    free(postings);
+    free(trigram_values);
+    free(trigram_first);
+    return ok;
+}
+
+// 建标题搜索索引 - 第一个参数为索引文件，其余为目录、文件或通配符，用与CPU核心数相同的线程并行解析
+int run_index_build(int argc, char* argv[]) {
+    const char* index_path = NULL;
+    int max_level = MAX_LEVEL;
+    int jobs = detect_cpu_count();
+    TextEncoding encoding = ENCODING_AUTO;
+    PathList files = { NULL, 0, 0 };
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            max_level = atoi(argv[++i]);
+            if (max_level < 1 || max_level > MAX_LEVEL) {
+                printf("Error: Level must be between 1-%d\n", MAX_LEVEL);
+                path_list_free(&files);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) jobs = 1;
+        } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+            if (!parse_encoding_name(argv[++i], &encoding)) {
+                printf("Error: Unknown encoding %s (use auto, utf8 or gbk)\n", argv[i]);
+                path_list_free(&files);
+                return 1;
+            }
+        } else if (index_path == NULL) {
+            index_path = argv[i];
+        } else {
+            #ifndef _WIN32
+            glob_t matches;
+            if (strpbrk(argv[i], "*?[") != NULL && glob(argv[i], 0, NULL, &matches) == 0) {
+                for (size_t j = 0; j < matches.gl_pathc; j++) {
+                    collect_markdown_files(matches.gl_pathv[j], &files);
+                }
+                globfree(&matches);
+                continue;
+            }
+            #endif
+            collect_markdown_files(argv[i], &files);
+        }
+    }
+    
+    if (index_path == NULL || strlen(index_path) >= MAX_PATH) {
+        printf("Error: Missing or invalid index file\n");
+        path_list_free(&files);
+        return 1;
+    }
+    if (files.count == 0) {
+        printf("No Markdown files found\n");
+        path_list_free(&files);
+        return 1;
+    }
+    
+    if (jobs > files.count) jobs = files.count;
+    
+    double start = now_seconds();
+    
+    IndexJob job;
+    job.files = &files;
+    job.max_level = max_level;
+    job.encoding = encoding;
+    job.parse_threads = detect_cpu_count() / jobs;
+    if (job.parse_threads < 1) job.parse_threads = 1;
+    job.next_index = 0;
+    job.failed = 0;
+    pthread_mutex_init(&job.mutex, NULL);
+    
+    IndexWorker* workers = (IndexWorker*)malloc((size_t)jobs * sizeof(IndexWorker));
+    pthread_t* threads = (pthread_t*)malloc((size_t)jobs * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobs; i++) {
+        workers[i].job = &job;
+        workers[i].segments = NULL;
+        workers[i].segment_count = 0;
+        workers[i].segment_capacity = 0;
+    }
+    
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[started], NULL, index_worker, &workers[started]) == 0) {
+            started++;
+        }
+    }
+    
+    // 线程创建失败时由主线程完成全部解析
+    if (started == 0) {
+        index_worker(&workers[0]);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    int worker_count = started > 0 ? started : 1;
+    long long headings = 0;
+    for (int i = 0; i < worker_count; i++) {
+        for (int g = 0; g < workers[i].segment_count; g++) {
+            headings += workers[i].segments[g].map.count;
+        }
+    }
+    
+    uint64_t index_size = 0;
+    bool ok = write_search_index(index_path, workers, worker_count, &files, max_level, &index_size);
+    double elapsed = now_seconds() - start;
+    if (ok) {
+        printf("Indexed %lld headings from %d files (%d failed) in %.2f s, %s is %.1f MB\n",
+               headings, files.count, job.failed, elapsed, index_path, (double)index_size / (1024.0 * 1024.0));
+    }
+    
+    for (int i = 0; i < jobs; i++) {
+        free_index_worker(&workers[i]);
+    }
+    pthread_mutex_destroy(&job.mutex);
+    free(workers);
+    free(threads);
+    int status = ok && job.failed == 0 ? 0 : 1;
+    path_list_free(&files);
+    return status;
+}
+
+// 映射打开标题搜索索引 - 只检查文件头和各段长度，耗时与标题数无关；查询时用到的偏移和编号再逐个检查
+bool open_search_index(const char* filename, SearchIndexView* view) {
+    memset(view, 0, sizeof(SearchIndexView));
+    
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return false;
+    }
+    bool loaded = load_input(file, &view->input);
+    fclose(file);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input %s\n", filename);
+        return false;
+    }
+    #ifndef _WIN32
+    // 查询只访问二分查找路过的少量页面
+    if (view->input.mapped) madvise((void*)view->input.data, view->input.size, MADV_RANDOM);
+    #endif
+    
+    SearchIndexHeader* header = &view->header;
+    if (view->input.size < sizeof(SearchIndexHeader)) {
+        fprintf(stderr, "Error: %s is not a heading index\n", filename);
+        close_search_index(view);
+        return false;
+    }
+    memcpy(header, view->input.data, sizeof(SearchIndexHeader));
+    
+    if (memcmp(header->magic, SEARCH_INDEX_MAGIC, 4) != 0 || header->byte_order != BINARY_BYTE_ORDER) {
+        fprintf(stderr, "Error: %s is not a heading index for this platform\n", filename);
+        close_search_index(view);
+        return false;
+    }
+    if (header->version != SEARCH_INDEX_VERSION) {
+        fprintf(stderr, "Error: Unsupported heading index version %d in %s\n", header->version, filename);
+        close_search_index(view);
+        return false;
+    }
+    
+    uint64_t words = (uint64_t)header->file_count + 2 * (uint64_t)header->key_count + 1 +
+                     2 * (uint64_t)header->heading_count + 2 * (uint64_t)header->trigram_count + 1 + header->posting_count;
+    uint64_t arrays = sizeof(SearchIndexHeader) + words * sizeof(uint32_t) + header->heading_count;
+    if (header->path_pool_size > view->input.size || header->title_pool_size > view->input.size ||
+        arrays + header->path_pool_size + header->title_pool_size != view->input.size ||
+        (header->path_pool_size > 0 && view->input.data[arrays + header->path_pool_size - 1] != '\0') ||
+        (header->title_pool_size > 0 && view->input.data[view->input.size - 1] != '\0')) {
+        fprintf(stderr, "Error: Heading index %s is truncated or corrupted\n", filename);
+        close_search_index(view);
+        return false;
+    }
+    
+    // 文件头48字节，32位数组都是4字节对齐的
+    const uint32_t* word = (const uint32_t*)(view->input.data + sizeof(SearchIndexHeader));
+    view->path_offsets = word;
+    word += header->file_count;
+    view->key_offsets = word;
+    word += header->key_count;
+    view->key_first = word;
+    word += (size_t)header->key_count + 1;
+    view->heading_files = word;
+    word += header->heading_count;
+    view->heading_lines = (const int*)word;
+    word += header->heading_count;
+    view->trigrams = word;
+    word += header->trigram_count;
+    view->trigram_first = word;
+    word += (size_t)header->trigram_count + 1;
+    view->postings = word;
+    word += header->posting_count;
+    view->heading_levels = (const uint8_t*)word;
+    view->path_pool = (const char*)word + header->heading_count;
+    view->title_pool = view->path_pool + header->path_pool_size;
+    return true;
+}
+
+// 关闭标题搜索索引，解除映射
+void close_search_index(SearchIndexView* view) {
+    release_input(&view->input);
+    memset(view, 0, sizeof(SearchIndexView));
+}
+
+// key的标题文本，编号或偏移越界（索引损坏）时按空标题处理
+const char* search_index_title(const SearchIndexView* view, uint32_t key) {
+    if (key >= view->header.key_count || view->key_offsets[key] >= view->header.title_pool_size) return "";
+    return view->title_pool + view->key_offsets[key];
+}
+
+// 判断文本是否包含已折叠的查询串（忽略大小写）
+bool folded_contains(const char* text, const char* query, size_t length) {
+    if (length == 0) return true;
+    unsigned char lead = (unsigned char)query[0];
+    for (const char* ptr = text; *ptr != '\0'; ptr++) {
+        if (fold_ascii((unsigned char)*ptr) == lead && compare_folded_prefix(ptr, query, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 候选key与一个倒排表求交集，结果留在candidates中；两者都升序，在倒排表中先倍增跨过较小的部分再二分
+int intersect_postings(uint32_t* candidates, int count, const uint32_t* list, uint32_t list_count) {
+    int kept = 0;
+    size_t low = 0;
+    for (int i = 0; i < count && low < list_count; i++) {
+        uint32_t target = candidates[i];
+        size_t bound = low;
+        size_t step = 1;
+        while (bound < list_count && list[bound] < target) {
+            low = bound + 1;
+            bound += step;
+            step *= 2;
+        }
+        if (bound > list_count) bound = list_count;
+        while (low < bound) {
+            size_t middle = low + (bound - low) / 2;
+            if (list[middle] < target) low = middle + 1;
+            else bound = middle;
+        }
+        if (low < list_count && list[low] == target) candidates[kept++] = target;
+    }
+    return kept;
+}
+
+// 前缀查找 - 忽略大小写以query开头的key在排序后连续，二分找出起止位置；query须已折叠
+int search_index_prefix(const SearchIndexView* view, const char* query, size_t length, uint32_t** keys) {
+    uint32_t low = 0;
+    uint32_t high = view->header.key_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (compare_folded_prefix(search_index_title(view, middle), query, length) < 0) low = middle + 1;
+        else high = middle;
+    }
+    uint32_t begin = low;
+    high = view->header.key_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (compare_folded_prefix(search_index_title(view, middle), query, length) <= 0) low = middle + 1;
+        else high = middle;
+    }
+    
+    int count = (int)(low - begin);
+    *keys = (uint32_t*)malloc(((size_t)count + 1) * sizeof(uint32_t));
+    if (*keys == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        (*keys)[i] = begin + (uint32_t)i;
+    }
+    return count;
+}
+
+// 子串查找 - 查询串的每个三元组都必须出现在key中，从最短的倒排表开始依次求交集，剩下的候选再逐个确认；query须已折叠
+// 查询串不足3字节时没有三元组可用，逐个检查所有key
+int search_index_substring(const SearchIndexView* view, const char* query, size_t length, uint32_t** keys) {
+    const SearchIndexHeader* header = &view->header;
+    uint32_t* candidates;
+    int count = 0;
+    
+    if (length < 3) {
+        candidates = (uint32_t*)malloc(((size_t)header->key_count + 1) * sizeof(uint32_t));
+        if (candidates == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        for (uint32_t k = 0; k < header->key_count; k++) {
+            candidates[count++] = k;
+        }
+    } else {
+        uint32_t* trigrams = (uint32_t*)malloc(length * sizeof(uint32_t));
+        if (trigrams == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        int trigram_count = unique_trigrams(query, length, trigrams);
+        
+        // 换成三元组在索引中的下标，有一个不存在或范围无效时不会有结果
+        bool missing = false;
+        for (int j = 0; j < trigram_count && !missing; j++) {
+            uint32_t low = 0;
+            uint32_t high = header->trigram_count;
+            while (low < high) {
+                uint32_t middle = low + (high - low) / 2;
+                if (view->trigrams[middle] < trigrams[j]) low = middle + 1;
+                else high = middle;
+            }
+            missing = low == header->trigram_count || view->trigrams[low] != trigrams[j] ||
+                      view->trigram_first[low] > view->trigram_first[low + 1] ||
+                      view->trigram_first[low + 1] > header->posting_count;
+            trigrams[j] = low;
+        }
+        
+        // 按倒排表长度从短到长排列（查询串很短，用选择排序）
+        for (int j = 0; j < trigram_count && !missing; j++) {
+            for (int m = j + 1; m < trigram_count; m++) {
+                uint32_t a = trigrams[j];
+                uint32_t b = trigrams[m];
+                if (view->trigram_first[b + 1] - view->trigram_first[b] < view->trigram_first[a + 1] - view->trigram_first[a]) {
+                    trigrams[j] = b;
+                    trigrams[m] = a;
+                }
+            }
+        }
+        
+        uint32_t seed = missing ? 0 : view->trigram_first[trigrams[0] + 1] - view->trigram_first[trigrams[0]];
+        candidates = (uint32_t*)malloc(((size_t)seed + 1) * sizeof(uint32_t));
+        if (candidates == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        if (!missing) {
+            memcpy(candidates, view->postings + view->trigram_first[trigrams[0]], (size_t)seed * sizeof(uint32_t));
+            count = (int)seed;
+            for (int j = 1; j < trigram_count && count > 0; j++) {
+                uint32_t t = trigrams[j];
+                count = intersect_postings(candidates, count, view->postings + view->trigram_first[t],
+                                           view->trigram_first[t + 1] - view->trigram_first[t]);
+            }
+        }
+        free(trigrams);
+    }
+    
+    // 三元组都出现不代表它们相邻，逐个确认
+    int matched = 0;
+    for (int i = 0; i < count; i++) {
+        if (folded_contains(search_index_title(view, candidates[i]), query, length)) {
+            candidates[matched++] = candidates[i];
+        }
+    }
+    *keys = candidates;
+    return matched;
+}
+
+// 输出查询结果，每行一个标题：路径:行号: 与级别相同个数的# 标题，最多limit行（为0时不限）；total返回全部匹配的标题数
+void render_query_results(const SearchIndexView* view, const uint32_t* keys, int key_count, int limit, OutputBuffer* output, int* total) {
+    const SearchIndexHeader* header = &view->header;
+    int written = 0;
+    *total = 0;
+    
+    for (int i = 0; i < key_count; i++) {
+        uint32_t key = keys[i];
+        if (key >= header->key_count) continue;
+        uint32_t begin = view->key_first[key];
+        uint32_t end = view->key_first[key + 1];
+        if (begin > end || end > header->heading_count) continue;
+        *total += (int)(end - begin);
+        
+        const char* title = search_index_title(view, key);
+        for (uint32_t h = begin; h < end && (limit == 0 || written < limit); h++) {
+            uint32_t file = view->heading_files[h];
+            const char* path = "?";
+            if (file < header->file_count && view->path_offsets[file] < header->path_pool_size) {
+                path = view->path_pool + view->path_offsets[file];
+            }
+            int level = view->heading_levels[h];
+            if (level < 1 || level > MAX_LEVEL) level = MAX_LEVEL;
+            
+            output_puts(output, path);
+            output_write(output, ":", 1);
+            output_int(output, view->heading_lines[h]);
+            output_write(output, ": ", 2);
+            output_write(output, "######", (size_t)level);
+            output_write(output, " ", 1);
+            output_puts(output, title);
+            output_write(output, "\n", 1);
+            written++;
+        }
+    }
+}
+
+// 在标题搜索索引中查找 - 默认按子串查找，--prefix时只找以查询串开头的标题，都忽略ASCII大小写
+// 多个查询参数以空格连接；结果写到标准输出，匹配数和耗时写到stderr
+int run_query(int argc, char* argv[]) {
+    const char* index_path = NULL;
+    bool prefix = false;
+    int limit = QUERY_DEFAULT_LIMIT;
+    char* query = NULL;
+    size_t length = 0;
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--prefix") == 0) {
+            prefix = true;
+        } else if (strcmp(argv[i], "--substring") == 0) {
+            prefix = false;
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit = atoi(argv[++i]);
+            if (limit < 0) limit = 0;
+        } else if (index_path == NULL) {
+            index_path = argv[i];
+        } else {
+            size_t word = strlen(argv[i]);
+            char* grown = (char*)realloc(query, length + word + 2);
+            if (grown == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            query = grown;
+            if (length > 0) query[length++] = ' ';
+            for (size_t j = 0; j < word; j++) {
+                query[length++] = (char)fold_ascii((unsigned char)argv[i][j]);
+            }
+            query[length] = '\0';
+        }
+    }
+    if (index_path == NULL || query == NULL) {
+        printf("Error: Missing index file or query\n");
+        free(query);
+        return 1;
+    }
+    
+    double start = now_seconds();
+    SearchIndexView view;
+    if (!open_search_index(index_path, &view)) {
+        free(query);
+        return 1;
+    }
+    
+    uint32_t* keys;
+    int key_count = prefix ? search_index_prefix(&view, query, length, &keys)
+                           : search_index_substring(&view, query, length, &keys);
+    
+    OutputBuffer output;
+    output_init(&output, stdout);
+    int total;
+    render_query_results(&view, keys, key_count, limit, &output, &total);
+    output_flush(&output);
+    output_free(&output);
+    double elapsed = now_seconds() - start;
+    
+    if (limit > 0 && total > limit) {
+        fprintf(stderr, "%d headings (%d distinct titles) in %.2f ms, showing the first %d\n",
+                total, key_count, elapsed * 1000.0, limit);
+    } else {
+        fprintf(stderr, "%d headings (%d distinct titles) in %.2f ms\n", total, key_count, elapsed * 1000.0);
+    }
+    
+    free(keys);
+    close_search_index(&view);
+    free(query);
+    return total > 0 ? 0 : 1;
+}
+
+#ifndef _WIN32
+// 写出全部数据，处理部分写入和信号中断
+bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// 从连接已收到的字节中取出下一行请求（不含换行符），一次读到的多个请求留在缓冲区中依次处理
+// 缓冲区中还没有完整的一行时返回false
+bool daemon_next_request(DaemonConnection* connection, char* line) {
+    char* newline = (char*)memchr(connection->request, '\n', connection->buffered);
+    if (newline == NULL) return false;
+    
+    size_t length = (size_t)(newline - connection->request);
+    memcpy(line, connection->request, length);
+    if (length > 0 && line[length - 1] == '\r') length--;
+    line[length] = '\0';
+    
+    connection->buffered -= (size_t)(newline + 1 - connection->request);
+    memmove(connection->request, newline + 1, connection->buffered);
+    return true;
+}
+
+// 读入请求的文件 - 小文件读到工作线程复用的缓冲区，避免每次请求mmap/munmap；大文件仍由load_input映射
+bool daemon_load(DaemonWorker* worker, const char* path, InputBuffer* input) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    
+    if (st.st_size >= DAEMON_MMAP_MIN) {
+        FILE* file = fdopen(fd, "rb");
+        if (file == NULL) {
+            close(fd);
+            return false;
+        }
+        bool loaded = load_input(file, input);
+        fclose(file);
+        return loaded;
+    }
+    
+    size_t size = (size_t)st.st_size;
+    if (size > worker->input_capacity) {
+        char* grown = (char*)realloc(worker->input, size);
+        if (grown == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        worker->input = grown;
+        worker->input_capacity = size;
+    }
+    
+    // 读入期间文件被截短时按实际读到的长度处理
+    size_t length = 0;
+    while (length < size) {
+        ssize_t n = read(fd, worker->input + length, size - length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        length += (size_t)n;
+    }
+    close(fd);
+    
+    input->data = worker->input;
+    input->size = length;
+    input->mapped = false;
+    input->owned = NULL;
+    return true;
+}
+
+// 处理一个请求，结果写入工作线程的输出缓冲区；出错时返回错误信息，成功时返回NULL
+// 普通请求"<级别> <格式> <路径>"：文本格式与--stdin的输出相同（不含文件头和文件尾）
+// 编辑请求"EDIT <起始行> <原行数> <新行数> <级别> <格式> <路径>"：文件从起始行开始的原行数行已替换为新行数行
+// 编辑请求使用连接的会话上下文，同一文件、同一级别的上次结果存在时只重新扫描变化的行，否则完整解析作为之后编辑的基础
+const char* daemon_render(DaemonWorker* worker, DaemonConnection* connection, const char* request) {
+    int max_level;
+    char format_name[16];
+    int path_offset = 0;
+    OutputFormat format;
+    int first_line = 0, old_line_count = 0, new_line_count = 0;
+    
+    bool edit = strncmp(request, "EDIT ", 5) == 0;
+    if (edit) {
+        int offset = 0;
+        if (sscanf(request + 5, "%d %d %d %n", &first_line, &old_line_count, &new_line_count, &offset) != 3 || offset == 0 ||
+            first_line < 1 || old_line_count < 0 || new_line_count < 0) {
+            return "Malformed edit range (expected: EDIT <first> <old> <new>)";
+        }
+        request += 5 + offset;
+    }
+    
+    if (sscanf(request, "%d %15s %n", &max_level, format_name, &path_offset) != 2 || path_offset == 0 ||
+        request[path_offset] == '\0') {
+        return "Malformed request (expected: <level> <format> <path>)";
+    }
+    if (max_level < 1 || max_level > MAX_LEVEL) {
+        return "Level must be between 1-6";
+    }
+    if (!parse_output_format(format_name, &format)) {
+        return "Unknown format (use txt, bin, json or opml)";
+    }
+    
+    InputBuffer input;
+    if (!daemon_load(worker, request + path_offset, &input)) {
+        return "Cannot read file";
+    }
+    decode_input(&input, worker->ctx->encoding);
+    
+    // 编辑后的文件必须包含被替换成的全部新行，不能依赖skip_lines在文件末尾静默截断
+    if (edit) {
+        long long needed = (long long)first_line - 1 + new_line_count;
+        long long lines = 0;
+        const char* ptr = input.data;
+        const char* end = input.data + input.size;
+        while (lines < needed && ptr < end) {
+            const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+            ptr = newline ? newline + 1 : end;
+            lines++;
+        }
+        if (lines < needed) {
+            release_input(&input);
+            return "Edit range is beyond the end of the file";
+        }
+    }
+    
+    worker->output.length = 0;
+    bool rendered;
+    if (edit) {
+        const char* path = request + path_offset;
+        if (connection->session == NULL) {
+            connection->session = create_parser_context();
+            connection->session->threads = worker->ctx->threads;
+            connection->session->encoding = worker->ctx->encoding;
+        }
+        
+        ParserContext* session = connection->session;
+        if (connection->session_path != NULL && strcmp(connection->session_path, path) == 0 && session->max_level == max_level) {
+            parse_markdown_edit(session, input.data, input.size, first_line, old_line_count, new_line_count);
+        } else {
+            free(connection->session_path);
+            connection->session_path = strdup(path);
+            if (connection->session_path == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            parse_markdown_parallel(session, input.data, input.size, max_level);
+        }
+        rendered = render_mind_map_body(session, format, &worker->output);
+    } else if (format == FORMAT_TEXT) {
+        rendered = render_markdown_fused(worker->ctx, input.data, input.size, max_level, &worker->output);
+    } else {
+        parse_markdown_parallel(worker->ctx, input.data, input.size, max_level);
+        rendered = render_mind_map_body(worker->ctx, format, &worker->output);
+    }
+    release_input(&input);
+    return rendered ? NULL : "Heading titles exceed 4 GiB";
+}
+
+// 发送响应 - 响应头和正文用一次writev发出，未写完的部分再逐段补写
+bool daemon_respond(int fd, const char* header, size_t header_length, const char* body, size_t body_length) {
+    struct iovec parts[2];
+    parts[0].iov_base = (void*)header;
+    parts[0].iov_len = header_length;
+    parts[1].iov_base = (void*)body;
+    parts[1].iov_len = body_length;
+    
+    ssize_t n;
+    do {
+        n = writev(fd, parts, body_length > 0 ? 2 : 1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return false;
+    
+    size_t sent = (size_t)n;
+    if (sent < header_length) {
+        if (!write_all(fd, header + sent, header_length - sent)) return false;
+        sent = header_length;
+    }
+    return write_all(fd, body + (sent - header_length), body_length - (sent - header_length));
+}
+
+// 处理一个连接上已到达的请求 - 成功时响应"OK <字节数>\n"加正文，失败时响应"ERR <信息>\n"
+// 读取不阻塞，没有更多数据时返回，连接交还分发线程等待下一个请求；连接关闭、出错或请求超长时标记closing
+void daemon_serve(DaemonWorker* worker, DaemonConnection* connection) {
+    char line[DAEMON_REQUEST_MAX];
+    char header[64];
+    
+    while (!connection->closing) {
+        if (daemon_next_request(connection, line)) {
+            const char* error = daemon_render(worker, connection, line);
+            bool ok;
+            if (error != NULL) {
+                int length = snprintf(header, sizeof(header), "ERR %s\n", error);
+                ok = write_all(connection->fd, header, (size_t)length < sizeof(header) ? (size_t)length : sizeof(header) - 1);
+            } else {
+                int length = snprintf(header, sizeof(header), "OK %zu\n", worker->output.length);
+                ok = daemon_respond(connection->fd, header, (size_t)length, worker->output.data, worker->output.length);
+            }
+            if (!ok) connection->closing = true;
+            continue;
+        }
+        if (connection->buffered == sizeof(connection->request)) {
+            const char* error = "ERR Request too long\n";
+            write_all(connection->fd, error, strlen(error));
+            connection->closing = true;
+            break;
+        }
+        
+        ssize_t n = recv(connection->fd, connection->request + connection->buffered,
+                         sizeof(connection->request) - connection->buffered, MSG_DONTWAIT);
+        if (n > 0) {
+            connection->buffered += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            connection->closing = true;
+        }
+    }
+    connection->last_active = now_seconds();
+}
+
+// 初始化工作线程的解析上下文和复用缓冲区
+void daemon_worker_init(DaemonWorker* worker, DaemonServer* server, int parse_threads) {
+    worker->server = server;
+    worker->ctx = create_parser_context();
+    worker->ctx->threads = parse_threads;
+    worker->input = NULL;
+    worker->input_capacity = 0;
+    output_init(&worker->output, NULL);
+}
+
+// 释放工作线程的解析上下文和缓冲区
+void daemon_worker_free(DaemonWorker* worker) {
+    output_free(&worker->output);
+    free(worker->input);
+    free_parser_context(worker->ctx);
+}
+
+// 守护进程工作线程 - 从就绪队列取出有数据的连接处理，处理完放入归还链表并唤醒分发线程
+void* daemon_worker(void* arg) {
+    DaemonWorker* worker = (DaemonWorker*)arg;
+    DaemonServer* server = worker->server;
+    
+    pthread_mutex_lock(&server->mutex);
+    while (1) {
+        while (server->ready_head == NULL && !server->stopping) {
+            pthread_cond_wait(&server->ready_cond, &server->mutex);
+        }
+        if (server->ready_head == NULL) break;
+        
+        DaemonConnection* connection = server->ready_head;
+        server->ready_head = connection->next;
+        if (server->ready_head == NULL) server->ready_tail = NULL;
+        pthread_mutex_unlock(&server->mutex);
+        
+        daemon_serve(worker, connection);
+        
+        pthread_mutex_lock(&server->mutex);
+        connection->next = server->returned;
+        server->returned = connection;
+        // 管道已满时分发线程必然还有未读的唤醒字节，丢弃这一次写入即可
+        ssize_t ignored = write(server->wake_pipe[1], "", 1);
+        (void)ignored;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return NULL;
+}
+
+// 关闭连接并释放它的会话上下文
+void daemon_close_connection(DaemonConnection* connection) {
+    close(connection->fd);
+    free_parser_context(connection->session);
+    free(connection->session_path);
+    free(connection);
+}
+
+// 把连接放回空闲列表由分发线程poll；已标记关闭的连接直接关闭
+void daemon_park(DaemonServer* server, DaemonConnection* connection) {
+    if (connection->closing) {
+        daemon_close_connection(connection);
+        return;
+    }
+    if (server->idle_count == server->idle_capacity) {
+        int capacity = server->idle_capacity > 0 ? server->idle_capacity * 2 : 64;
+        DaemonConnection** idle = (DaemonConnection**)realloc(server->idle, (size_t)capacity * sizeof(DaemonConnection*));
+        if (idle == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        server->idle = idle;
+        server->idle_capacity = capacity;
+    }
+    server->idle[server->idle_count++] = connection;
+}
+
+// 接受所有等待中的连接 - 监听套接字为非阻塞，没有新连接时返回
+// 发送设置超时，不读取响应的客户端不会一直占住工作线程
+void daemon_accept(DaemonServer* server) {
+    while (1) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        
+        struct timeval timeout = { DAEMON_SEND_TIMEOUT, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        DaemonConnection* connection = (DaemonConnection*)malloc(sizeof(DaemonConnection));
+        if (connection == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        connection->fd = fd;
+        connection->closing = false;
+        connection->last_active = now_seconds();
+        connection->buffered = 0;
+        connection->session = NULL;
+        connection->session_path = NULL;
+        connection->next = NULL;
+        daemon_park(server, connection);
+    }
+}
+
+// 分发循环 - 用一次poll同时等待新连接、工作线程的唤醒和所有空闲连接
+// 有数据或已断开的连接交给工作线程，空闲超过DAEMON_IDLE_TIMEOUT秒的连接关闭
+// inline_worker不为NULL时（没有工作线程）在本线程直接处理；只在poll出错时返回
+void daemon_dispatch(DaemonServer* server, DaemonWorker* inline_worker) {
+    struct pollfd* fds = NULL;
+    int fds_capacity = 0;
+    
+    while (1) {
+        pthread_mutex_lock(&server->mutex);
+        DaemonConnection* returned = server->returned;
+        server->returned = NULL;
+        pthread_mutex_unlock(&server->mutex);
+        while (returned != NULL) {
+            DaemonConnection* next = returned->next;
+            daemon_park(server, returned);
+            returned = next;
+        }
+        
+        int count = server->idle_count;
+        if (count + 2 > fds_capacity) {
+            fds_capacity = (count + 2) * 2;
+            fds = (struct pollfd*)realloc(fds, (size_t)fds_capacity * sizeof(struct pollfd));
+            if (fds == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+        }
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = server->wake_pipe[0];
+        fds[1].events = POLLIN;
+        for (int i = 0; i < count; i++) {
+            fds[i + 2].fd = server->idle[i]->fd;
+            fds[i + 2].events = POLLIN;
+        }
+        
+        int ready = poll(fds, (nfds_t)(count + 2), 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            char drain[256];
+            while (read(server->wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        }
+        
+        double now = now_seconds();
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            DaemonConnection* connection = server->idle[i];
+            if (fds[i + 2].revents != 0) {
+                connection->next = NULL;
+                if (inline_worker != NULL) {
+                    daemon_serve(inline_worker, connection);
+                    connection->next = server->returned;
+                    server->returned = connection;
+                    continue;
+                }
+                pthread_mutex_lock(&server->mutex);
+                if (server->ready_tail != NULL) server->ready_tail->next = connection;
+                else server->ready_head = connection;
+                server->ready_tail = connection;
+                pthread_cond_signal(&server->ready_cond);
+                pthread_mutex_unlock(&server->mutex);
+            } else if (now - connection->last_active > DAEMON_IDLE_TIMEOUT) {
+                daemon_close_connection(connection);
+            } else {
+                server->idle[kept++] = connection;
+            }
+        }
+        server->idle_count = kept;
+        
+        if (fds[0].revents & POLLIN) {
+            daemon_accept(server);
+        }
+    }
+    free(fds);
+}
+
+// 创建监听套接字 - 路径上残留的套接字文件没有进程在监听时删除重建，有守护进程在运行时报错
+int open_daemon_socket(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            fprintf(stderr, "Error: A daemon is already listening on %s\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+    
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, DAEMON_BACKLOG) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 守护进程模式 - 监听Unix域套接字，主线程分发请求，固定数量的工作线程处理转换，进程一直运行直到被终止
+// 连接只在有请求到达时占用工作线程，空闲的客户端再多也不会让其他客户端等待
+int run_daemon(int argc, char* argv[]) {
+    const char* path = NULL;
+    int jobs = detect_cpu_count();
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) jobs = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        printf("Error: Missing socket path\n");
+        return 1;
+    }
+    
+    // 客户端提前断开时write返回错误，而不是让整个进程收到SIGPIPE退出
+    signal(SIGPIPE, SIG_IGN);
+    
+    int listen_fd = open_daemon_socket(path);
+    if (listen_fd < 0) return 1;
+    
+    DaemonServer server;
+    memset(&server, 0, sizeof(server));
+    server.listen_fd = listen_fd;
+    if (pipe(server.wake_pipe) != 0) {
+        perror("pipe");
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(server.wake_pipe[0], F_SETFL, fcntl(server.wake_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(server.wake_pipe[1], F_SETFL, fcntl(server.wake_pipe[1], F_GETFL) | O_NONBLOCK);
+    pthread_mutex_init(&server.mutex, NULL);
+    pthread_cond_init(&server.ready_cond, NULL);
+    
+    DaemonWorker* workers = (DaemonWorker*)malloc((size_t)jobs * sizeof(DaemonWorker));
+    pthread_t* threads = (pthread_t*)malloc((size_t)jobs * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    int parse_threads = detect_cpu_count() / jobs;
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        daemon_worker_init(&workers[started], &server, parse_threads > 1 ? parse_threads : 1);
+        if (pthread_create(&threads[started], NULL, daemon_worker, &workers[started]) == 0) {
+            started++;
+        } else {
+            daemon_worker_free(&workers[started]);
+        }
+    }
+    
+    printf("Listening on %s with %d threads\n", path, started > 0 ? started : 1);
+    fflush(stdout);
+    
+    // 线程创建失败时由主线程处理请求
+    if (started == 0) {
+        daemon_worker_init(&workers[0], &server, 1);
+        daemon_dispatch(&server, &workers[0]);
+        daemon_worker_free(&workers[0]);
+    } else {
+        daemon_dispatch(&server, NULL);
+    }
+    
+    pthread_mutex_lock(&server.mutex);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.ready_cond);
+    pthread_mutex_unlock(&server.mutex);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        daemon_worker_free(&workers[i]);
+    }
+    
+    while (server.returned != NULL) {
+        DaemonConnection* next = server.returned->next;
+        daemon_close_connection(server.returned);
+        server.returned = next;
+    }
+    for (int i = 0; i < server.idle_count; i++) {
+        daemon_close_connection(server.idle[i]);
+    }
+    free(server.idle);
+    pthread_cond_destroy(&server.ready_cond);
+    pthread_mutex_destroy(&server.mutex);
+    close(server.wake_pipe[0]);
+    close(server.wake_pipe[1]);
+    close(listen_fd);
+    unlink(path);
+    free(workers);
+    free(threads);
+    return 1;
+}
+
+// 向守护进程发送一个请求并把结果写到标准输出，路径转换为绝对路径后发送
+int run_daemon_request(int argc, char* argv[]) {
+    const char* socket_path = NULL;
+    const char* filename = NULL;
+    int max_level = MAX_LEVEL;
+    const char* format_name = "txt";
+    OutputFormat format;
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            max_level = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format_name = argv[++i];
+        } else if (socket_path == NULL) {
+            socket_path = argv[i];
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (socket_path == NULL || filename == NULL) {
+        printf("Error: Missing socket path or file\n");
+        return 1;
+    }
+    if (!parse_output_format(format_name, &format)) {
+        printf("Error: Unknown format %s (use txt, bin, json or opml)\n", format_name);
+        return 1;
+    }
+    
+    char absolute[MAX_PATH];
+    if (realpath(filename, absolute) == NULL) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 1;
+    }
+    
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error: Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    
+    char request[DAEMON_REQUEST_MAX + 32];
+    int length = snprintf(request, sizeof(request), "%d %s %s\n", max_level, format_name, absolute);
+    if (!write_all(fd, request, (size_t)length)) {
+        fprintf(stderr, "Error: Failed to send request\n");
+        close(fd);
+        return 1;
+    }
+    
+    // 响应头之后的正文原样写到标准输出
+    FILE* response = fdopen(fd, "rb");
+    char header[DAEMON_REQUEST_MAX];
+    if (response == NULL || fgets(header, sizeof(header), response) == NULL) {
+        fprintf(stderr, "Error: No response from daemon\n");
+        if (response != NULL) fclose(response); else close(fd);
+        return 1;
+    }
+    
+    unsigned long long remaining;
+    if (sscanf(header, "OK %llu", &remaining) != 1) {
+        fprintf(stderr, "Error: %s", strncmp(header, "ERR ", 4) == 0 ? header + 4 : header);
+        fclose(response);
+        return 1;
+    }
+    
+    char buffer[READ_CHUNK_SIZE];
+    while (remaining > 0) {
+        size_t n = fread(buffer, 1, remaining < sizeof(buffer) ? (size_t)remaining : sizeof(buffer), response);
+        if (n == 0) break;
+        fwrite(buffer, 1, n, stdout);
+        remaining -= n;
+    }
+    fclose(response);
+    
+    if (remaining > 0) {
+        fprintf(stderr, "Error: Response truncated\n");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#ifdef __linux__
+// 记录一个有变化的文件，等这一批事件结束后再处理；同一文件的多次事件只记一次
+void watch_mark(WatchJob* job, const char* path) {
+    pthread_mutex_lock(&job->mutex);
+    int index = cache_find_or_add(&job->files, path);
+    if (job->files.capacity > job->watched_capacity) {
+        WatchFile* watched = (WatchFile*)realloc(job->watched, (size_t)job->files.capacity * sizeof(WatchFile));
+        if (watched == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        memset(watched + job->watched_capacity, 0, (size_t)(job->files.capacity - job->watched_capacity) * sizeof(WatchFile));
+        job->watched = watched;
+        job->watched_capacity = job->files.capacity;
+    }
+    bool added = !job->watched[index].pending;
+    job->watched[index].pending = true;
+    pthread_mutex_unlock(&job->mutex);
+    
+    if (added) {
+        if (job->pending_count == job->pending_capacity) {
+            int capacity = job->pending_capacity > 0 ? job->pending_capacity * 2 : PATH_LIST_INITIAL;
+            int* list = (int*)realloc(job->pending_list, (size_t)capacity * sizeof(int));
+            if (list == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            job->pending_list = list;
+            job->pending_capacity = capacity;
+        }
+        job->pending_list[job->pending_count++] = index;
+    }
+}
+
+// 记录目录下的全部Markdown文件
+void watch_mark_tree(WatchJob* job, const char* path) {
+    PathList files = { NULL, 0, 0 };
+    collect_markdown_files(path, &files);
+    for (int i = 0; i < files.count; i++) {
+        watch_mark(job, files.items[i]);
+    }
+    path_list_free(&files);
+}
+
+// 文件下标放入工作队列（调用方持有mutex），队列满时扩容并把环形队列展开
+void watch_queue_push(WatchJob* job, int index) {
+    if (job->queue_count == job->queue_capacity) {
+        int capacity = job->queue_capacity > 0 ? job->queue_capacity * 2 : PATH_LIST_INITIAL;
+        int* queue = (int*)malloc((size_t)capacity * sizeof(int));
+        if (queue == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        for (int i = 0; i < job->queue_count; i++) {
+            queue[i] = job->queue[(job->queue_head + i) % job->queue_capacity];
+        }
+        free(job->queue);
+        job->queue = queue;
+        job->queue_head = 0;
+        job->queue_capacity = capacity;
+    }
+    job->queue[(job->queue_head + job->queue_count) % job->queue_capacity] = index;
+    job->queue_count++;
+}
+
+// 一批事件结束 - 等待中的文件交给工作线程，正在处理的文件标记为处理完后重做
+void watch_flush_pending(WatchJob* job) {
+    pthread_mutex_lock(&job->mutex);
+    for (int i = 0; i < job->pending_count; i++) {
+        WatchFile* file = &job->watched[job->pending_list[i]];
+        file->pending = false;
+        if (file->state == WATCH_IDLE) {
+            file->state = WATCH_QUEUED;
+            watch_queue_push(job, job->pending_list[i]);
+        } else if (file->state == WATCH_RUNNING) {
+            file->state = WATCH_RERUN;
+        }
+    }
+    job->pending_count = 0;
+    pthread_cond_broadcast(&job->ready);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// 递归监视目录及其子目录（不跟随符号链接）；同一目录再次加入时inotify返回原来的描述符，只更新路径
+void watch_add_tree(WatchJob* job, const char* path) {
+    int wd = inotify_add_watch(job->inotify_fd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (wd < 0) {
+        fprintf(stderr, "Error: Cannot watch %s: %s\n", path, strerror(errno));
+        return;
+    }
+    
+    if (wd >= job->directory_capacity) {
+        int capacity = job->directory_capacity > 0 ? job->directory_capacity : PATH_LIST_INITIAL;
+        while (capacity <= wd) capacity *= 2;
+        char** directories = (char**)realloc(job->directories, (size_t)capacity * sizeof(char*));
+        if (directories == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        memset(directories + job->directory_capacity, 0, (size_t)(capacity - job->directory_capacity) * sizeof(char*));
+        job->directories = directories;
+        job->directory_capacity = capacity;
+    }
+    
+    char* copy = (char*)malloc(strlen(path) + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    strcpy(copy, path);
+    free(job->directories[wd]);
+    job->directories[wd] = copy;
+    
+    DIR* dir = opendir(path);
+    if (dir == NULL) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        
+        char child[MAX_PATH];
+        int length = snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (length < 0 || length >= (int)sizeof(child)) continue;
+        
+        struct stat st;
+        if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            watch_add_tree(job, child);
+        }
+    }
+    closedir(dir);
+}
+
+// 处理一个有变化的文件 - 大小和修改时间都没变时直接返回；否则计算内容哈希，与上次渲染时相同则只更新记录
+// 第一次处理的文件如果输出文件比它新，视为已是最新，不重新渲染
+void watch_convert(WatchJob* job, ParserContext* ctx, int index) {
+    pthread_mutex_lock(&job->mutex);
+    CacheEntry entry = job->files.entries[index];
+    pthread_mutex_unlock(&job->mutex);
+    
+    // 文件已被删除或改名时没有需要更新的内容
+    struct stat st;
+    if (stat(entry.path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    
+    // inotify已报告文件被写入，不能按大小和修改时间跳过：修改时间只精确到秒，同一秒内的两次保存看起来相同
+    // 只有内容哈希与上次渲染时相同才跳过
+    FILE* file = fopen(entry.path, "r");
+    if (file == NULL) return;
+    InputBuffer input;
+    bool loaded = load_input(file, &input);
+    fclose(file);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input %s\n", entry.path);
+        return;
+    }
+    uint64_t hash = hash_bytes(input.data, input.size, 0);
+    release_input(&input);
+    
+    char output_filename[MAX_PATH];
+    generate_output_filename(entry.path, output_filename);
+    set_output_extension(output_filename, job->format);
+    
+    struct stat output_st;
+    bool current = stat(output_filename, &output_st) == 0 &&
+                   (entry.size < 0 ? output_st.st_mtime > st.st_mtime : hash == entry.hash);
+    if (!current) {
+        double start = now_seconds();
+        if (!convert_markdown_file(ctx, entry.path, job->max_level, job->format)) return;
+        printf("Updated %s (%.1f ms)\n", output_filename, (now_seconds() - start) * 1000.0);
+        fflush(stdout);
+    }
+    
+    pthread_mutex_lock(&job->mutex);
+    CacheEntry* updated = &job->files.entries[index];
+    updated->size = (long long)st.st_size;
+    updated->mtime = (long long)st.st_mtime;
+    updated->hash = hash;
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// 监视工作线程 - 使用自己的解析上下文，从队列中领取文件处理，进程被终止前一直运行
+void* watch_worker(void* arg) {
+    WatchJob* job = (WatchJob*)arg;
+    ParserContext* ctx = create_parser_context();
+    
+    pthread_mutex_lock(&job->mutex);
+    while (1) {
+        while (job->queue_count == 0) {
+            pthread_cond_wait(&job->ready, &job->mutex);
+        }
+        int index = job->queue[job->queue_head];
+        job->queue_head = (job->queue_head + 1) % job->queue_capacity;
+        job->queue_count--;
+        job->watched[index].state = WATCH_RUNNING;
+        pthread_mutex_unlock(&job->mutex);
+        
+        watch_convert(job, ctx, index);
+        
+        pthread_mutex_lock(&job->mutex);
+        if (job->watched[index].state == WATCH_RERUN) {
+            job->watched[index].state = WATCH_QUEUED;
+            watch_queue_push(job, index);
+        } else {
+            job->watched[index].state = WATCH_IDLE;
+        }
+    }
+    return NULL;
+}
+
+// 处理一次读到的inotify事件 - 新目录加入监视并记录其中的文件；事件队列溢出时重新记录全部文件，由内容哈希过滤
+void watch_handle_events(WatchJob* job, const char* buffer, size_t length, char** roots, int root_count) {
+    const char* ptr = buffer;
+    while (ptr < buffer + length) {
+        const struct inotify_event* event = (const struct inotify_event*)ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+        
+        if (event->mask & IN_Q_OVERFLOW) {
+            for (int i = 0; i < root_count; i++) {
+                watch_mark_tree(job, roots[i]);
+            }
+            continue;
+        }
+        if (event->wd < 0 || event->wd >= job->directory_capacity || job->directories[event->wd] == NULL) continue;
+        if (event->mask & IN_IGNORED) {
+            free(job->directories[event->wd]);
+            job->directories[event->wd] = NULL;
+            continue;
+        }
+        if (event->len == 0 || event->name[0] == '.') continue;
+        
+        char child[MAX_PATH];
+        int written = snprintf(child, sizeof(child), "%s/%s", job->directories[event->wd], event->name);
+        if (written < 0 || written >= (int)sizeof(child)) continue;
+        
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                watch_add_tree(job, child);
+                watch_mark_tree(job, child);
+            }
+        } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && has_markdown_extension(event->name)) {
+            watch_mark(job, child);
+        }
+    }
+}
+
+// 监视模式 - 监视目录树，文件写入完成或移入时记下；一批事件结束（静默WATCH_DEBOUNCE_MS毫秒，
+// 或持续不断时最多WATCH_MAX_DELAY_MS毫秒）后交给工作线程，只有内容变化的文件才重新渲染
+int run_watch(int argc, char* argv[]) {
+    WatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.max_level = MAX_LEVEL;
+    job.format = FORMAT_TEXT;
+    int jobs = detect_cpu_count();
+    int debounce = WATCH_DEBOUNCE_MS;
+    char** roots = (char**)malloc((size_t)argc * sizeof(char*));
+    int root_count = 0;
+    if (roots == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            job.max_level = atoi(argv[++i]);
+            if (job.max_level < 1 || job.max_level > MAX_LEVEL) {
+                printf("Error: Level must be between 1-%d\n", MAX_LEVEL);
+                free(roots);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) jobs = 1;
+        } else if (strcmp(argv[i], "--debounce") == 0 && i + 1 < argc) {
+            debounce = atoi(argv[++i]);
+            if (debounce < 0) debounce = 0;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!parse_output_format(argv[++i], &job.format)) {
+                printf("Error: Unknown format %s (use txt, bin, json or opml)\n", argv[i]);
+                free(roots);
+                return 1;
+            }
+        } else {
+            struct stat st;
+            if (stat(argv[i], &st) != 0 || !S_ISDIR(st.st_mode)) {
+                printf("Error: %s is not a directory\n", argv[i]);
+                free(roots);
+                return 1;
+            }
+            roots[root_count++] = argv[i];
+        }
+    }
+    if (root_count == 0) {
+        printf("Error: Missing directory to watch\n");
+        free(roots);
+        return 1;
+    }
+    
+    job.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (job.inotify_fd < 0) {
+        perror("inotify_init1");
+        free(roots);
+        return 1;
+    }
+    cache_init(&job.files);
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.ready, NULL);
+    
+    // 先建立监视再扫描文件，扫描期间的修改不会漏掉；启动时所有文件都检查一遍
+    for (int i = 0; i < root_count; i++) {
+        watch_add_tree(&job, roots[i]);
+        watch_mark_tree(&job, roots[i]);
+    }
+    int initial = job.pending_count;
+    
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, watch_worker, &job) == 0) {
+            pthread_detach(thread);
+            started++;
+        }
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        return 1;
+    }
+    printf("Watching %d files with %d threads (press Ctrl+C to stop)\n", initial, started);
+    fflush(stdout);
+    watch_flush_pending(&job);
+    
+    char* buffer = (char*)malloc(WATCH_EVENT_BUFFER);
+    if (buffer == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    double first_event = 0;
+    double last_event = 0;
+    while (1) {
+        int timeout = -1;
+        if (job.pending_count > 0) {
+            double now = now_seconds();
+            double quiet = last_event + debounce / 1000.0;
+            double limit = first_event + WATCH_MAX_DELAY_MS / 1000.0;
+            double deadline = quiet < limit ? quiet : limit;
+            timeout = deadline > now ? (int)((deadline - now) * 1000.0) + 1 : 0;
+        }
+        
+        struct pollfd poll_fd = { job.inotify_fd, POLLIN, 0 };
+        int ready = poll(&poll_fd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        
+        if (ready > 0) {
+            ssize_t n = read(job.inotify_fd, buffer, WATCH_EVENT_BUFFER);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("read");
+                break;
+            }
+            int before = job.pending_count;
+            watch_handle_events(&job, buffer, (size_t)n, roots, root_count);
+            if (job.pending_count > 0) {
+                last_event = now_seconds();
+                if (before == 0) first_event = last_event;
+            }
+        }
+        
+        if (job.pending_count > 0) {
+            double now = now_seconds();
+            if (now - last_event >= debounce / 1000.0 || now - first_event >= WATCH_MAX_DELAY_MS / 1000.0) {
+                watch_flush_pending(&job);
+            }
+        }
+    }
+    
+    free(buffer);
+    free(roots);
+    close(job.inotify_fd);
+    return 1;
+}
+#endif
+
+// 获取当前时间（秒），用于性能测试计时
+double now_seconds() {
+    struct timespec ts;
+    #ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+    #else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    #endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// 兄弟节点性能测试 - 生成只含一个#和大量##章节的扁平文档，测量建树耗时
+// 同时生成扁平思维导图，对比两种表示的每个标题内存占用
+void run_sibling_benchmark(int count) {
+    size_t capacity = (size_t)count * 32 + 64;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    ParserContext* ctx = create_parser_context();
+    FlatMindMap flat;
+    flat_mind_map_init(&flat);
+    
+    printf("Sibling benchmark: one '#' heading followed by N '##' sections\n");
+    printf("%12s %12s %12s %12s %12s %12s\n", "Siblings", "Time(ms)", "ns/heading", "Flat(ms)", "Tree B/node", "Flat B/node");
+    
+    // 依次测试 N/100、N/10、N，耗时应与N成线性关系
+    const int divisors[] = { 100, 10, 1 };
+    for (int d = 0; d < 3; d++) {
+        int n = count / divisors[d];
+        if (n < 1) continue;
+        
+        size_t size = (size_t)snprintf(data, capacity, "# Benchmark\n");
+        for (int i = 0; i < n; i++) {
+            size += (size_t)snprintf(data + size, capacity - size, "## Section %d\nbody\n", i);
+        }
+        
+        double start = now_seconds();
+        parse_markdown_buffer(ctx, data, size, MAX_LEVEL);
+        double elapsed = now_seconds() - start;
+        
+        start = now_seconds();
+        build_flat_mind_map(ctx, &flat);
+        double flat_elapsed = now_seconds() - start;
+        free_tree(ctx);
+        
+        // 两种表示的标题文本大小相同，只是存放位置不同
+        double titles = (double)flat.pool_size / flat.count;
+        double tree_bytes = sizeof(HeadingNode) + sizeof(HeadingNode*) + titles;
+        double flat_bytes = sizeof(uint8_t) + sizeof(int) + sizeof(uint32_t) + sizeof(int) + titles;
+        
+        printf("%12d %12.2f %12.1f %12.2f %12.1f %12.1f\n", n, elapsed * 1e3, elapsed * 1e9 / n,
+               flat_elapsed * 1e3, tree_bytes, flat_bytes);
+    }
+    
+    free_flat_mind_map(&flat);
+    free_parser_context(ctx);
+    free(data);
+}
+
+// 输出流式转换中已结束的顶层子树，然后清空以便收集下一个
+void flush_stream_section(FlatMindMap* section, bool more_follows, OutputBuffer* output) {
+    flat_mind_map_finish(section);
+    render_flat_nodes(section, more_follows, output);
+    section->count = 0;
+    section->pool_size = 0;
+}
+
+// 初始化融合渲染器，section由调用方提供以便复用内存
+void fused_renderer_init(FusedRenderer* renderer, FlatMindMap* section, int max_level, OutputBuffer* output, ConversionStats* stats) {
+    renderer->section = section;
+    renderer->output = output;
+    renderer->stats = stats;
+    renderer->max_level = max_level;
+    renderer->found = false;
+    renderer->started = false;
+    renderer->peak_count = 0;
+    renderer->overflow = false;
+    title_text_init(&renderer->title);
+    section->count = 0;
+    section->pool_size = 0;
+}
+
+// 加入一个标题 - 不低于当前顶层节点级别的标题会成为新的顶层节点，前一个顶层子树到此结束并立即渲染
+// title为原始标题文本，行内标记在这里去掉
+void fused_renderer_add(FusedRenderer* renderer, int level, int line_number, const char* title, size_t title_length) {
+    FlatMindMap* section = renderer->section;
+    if (renderer->overflow) return;
+    
+    if (section->count > 0 && level <= section->levels[0]) {
+        STATS_BEGIN(renderer->stats, render_timer, PHASE_RENDER);
+        flush_stream_section(section, true, renderer->output);
+        STATS_END(renderer->stats, render_timer);
+    }
+    if (!renderer->found) {
+        output_puts(renderer->output, "[D] Document Structure\n");
+        renderer->found = true;
+    }
+    STATS_BEGIN(renderer->stats, build_timer, PHASE_BUILD);
+    normalize_title(title, title_length, &renderer->title);
+    renderer->overflow = !flat_mind_map_append_title(section, level, line_number, &renderer->title);
+    if (section->count > renderer->peak_count) renderer->peak_count = section->count;
+    STATS_ADD(renderer->stats, nodes, 1);
+    STATS_END(renderer->stats, build_timer);
+}
+
+// 扫描[ptr, end)中的完整行 - ptr必须位于行首，line_number为该行行号并随扫描更新
+// 块状态保存在渲染器中，代码块和front matter可以跨越多次调用
+void fused_renderer_feed(FusedRenderer* renderer, const char* ptr, const char* end, int* line_number) {
+    if (!renderer->started) {
+        if (ptr == end) return;
+        ptr = begin_block_scan(&renderer->block, ptr, end, line_number);
+        renderer->started = true;
+    }
+    ptr = skip_front_matter(&renderer->block, ptr, end, line_number);
+    
+    STATS_BEGIN(renderer->stats, scan_timer, PHASE_SCAN);
+    while ((ptr = find_heading_candidate(&renderer->block, ptr, end, line_number)) < end) {
+        const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+        const char* line_end = newline ? newline : end;
+        
+        int level;
+        const char* title;
+        size_t title_length;
+        STATS_ADD(renderer->stats, candidates, 1);
+        
+        if (scan_block_line(&renderer->block, ptr, (size_t)(line_end - ptr), &level, &title, &title_length)) {
+            STATS_ADD(renderer->stats, headings[level], 1);
+            if (level <= renderer->max_level) {
+                fused_renderer_add(renderer, level, *line_number, title, title_length);
+            }
+        }
+        
+        if (newline == NULL) break;
+        ptr = newline + 1;
+        (*line_number)++;
+    }
+    STATS_END(renderer->stats, scan_timer);
+}
+
+// 输入结束 - 渲染最后一个顶层子树，没有任何标题时输出提示，并释放渲染器自己的内存
+// 有标题超出字符串池上限时输出不完整，返回false
+bool fused_renderer_finish(FusedRenderer* renderer) {
+    title_text_free(&renderer->title);
+    if (renderer->section->count > 0) {
+        STATS_BEGIN(renderer->stats, render_timer, PHASE_RENDER);
+        flush_stream_section(renderer->section, false, renderer->output);
+        STATS_END(renderer->stats, render_timer);
+    } else if (!renderer->found) {
+        char message[64];
+        snprintf(message, sizeof(message), "No headings found at level %d or below\n", renderer->max_level);
+        output_puts(renderer->output, message);
+    }
+    return !renderer->overflow;
+}
+
+// 融合解析渲染内存中的整个文档 - 输出与parse_markdown_buffer加render_mind_map完全一致，
+// 但不创建节点、不复制到内存池，只保留当前顶层子树的标题
+// 上下文threads大于1且输入足够大时，先多线程扫描出标题记录，再按顺序交给渲染器；标题超出字符串池上限时返回false
+bool render_markdown_fused(ParserContext* ctx, const char* data, size_t size, int max_level, OutputBuffer* output) {
+    FusedRenderer renderer;
+    fused_renderer_init(&renderer, &ctx->section, max_level, output, &ctx->stats);
+    
+    if (ctx->threads > 1 && size >= 2 * (size_t)PARALLEL_CHUNK_MIN) {
+        const char* end = data + size;
+        int line_number = 1;
+        const char* ptr = begin_block_scan(&renderer.block, data, end, &line_number);
+        ptr = skip_front_matter(&renderer.block, ptr, end, &line_number);
+        renderer.started = true;
+        
+        STATS_BEGIN(&ctx->stats, scan_timer, PHASE_SCAN);
+        ChunkScan* chunks;
+        int count = scan_chunks_parallel(ptr, (size_t)(end - ptr), ctx->threads, &chunks);
+        int line_offset = line_number - 1;
+        for (int i = 0; i < count; i++) {
+            STATS_ADD(&ctx->stats, candidates, chunks[i].count);
+            for (int j = 0; j < chunks[i].count; j++) {
+                const CandidateLine* record = &chunks[i].records[j];
+                int level;
+                const char* title;
+                size_t title_length;
+                if (scan_block_line(&renderer.block, record->line, record->length, &level, &title, &title_length)) {
+                    STATS_ADD(&ctx->stats, headings[level], 1);
+                    if (level <= max_level) {
+                        fused_renderer_add(&renderer, level, record->line_number + line_offset, title, title_length);
+                    }
+                }
+            }
+            line_offset += chunks[i].lines;
+        }
+        STATS_ADD(&ctx->stats, lines_scanned, line_offset + (data[size - 1] != '\n'));
+        STATS_END(&ctx->stats, scan_timer);
+        free_chunk_scans(chunks, count);
+    } else {
+        int line_number = 1;
+        fused_renderer_feed(&renderer, data, data + size, &line_number);
+        STATS_ADD(&ctx->stats, lines_scanned, line_number - 1 + (size > 0 && data[size - 1] != '\n'));
+    }
+    
+    return fused_renderer_finish(&renderer);
+}
+
+// 融合解析渲染文件 - 读取失败时与parse_markdown_file一样按空文档输出并返回false，标题超出上限时也返回false
+bool render_markdown_file_fused(ParserContext* ctx, FILE* file, int max_level, OutputBuffer* output) {
+    InputBuffer input;
+    
+    STATS_BEGIN(&ctx->stats, read_timer, PHASE_READ);
+    bool loaded = load_input(file, &input);
+    STATS_END(&ctx->stats, read_timer);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read input\n");
+        render_markdown_fused(ctx, "", 0, max_level, output);
+        return false;
+    }
+    STATS_ADD(&ctx->stats, bytes_read, input.size);
+    
+    STATS_BEGIN(&ctx->stats, decode_timer, PHASE_DECODE);
+    decode_input(&input, ctx->encoding);
+    STATS_END(&ctx->stats, decode_timer);
+    bool rendered = render_markdown_fused(ctx, input.data, input.size, max_level, output);
+    release_input(&input);
+    return rendered;
+}
+
+// 流式转换 - 分块读取input，交给融合渲染器，遇到同级或更高级标题即输出前一个已结束的顶层子树
+// 只保留当前顶层子树的标题和未读完的一行，内存与文档总大小无关
+// encoding为ENCODING_AUTO时按第一块含非ASCII字节的数据判断编码，之后沿用；GBK尾字节不会是换行符，按行切分的块可以各自转码
+int stream_markdown(FILE* input, FILE* output, int max_level, TextEncoding encoding, ConversionStats* stats) {
+    STATS_BEGIN(stats, timer, PHASE_OTHER);
+    OutputBuffer out;
+    output_init(&out, output);
+    out.stats = stats;
+    FlatMindMap section;
+    flat_mind_map_init(&section);
+    FusedRenderer renderer;
+    fused_renderer_init(&renderer, &section, max_level, &out, stats);
+    
+    size_t capacity = READ_CHUNK_SIZE * 2;
+    char* buffer = (char*)malloc(capacity);
+    if (buffer == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    size_t length = 0;
+    int line_number = 1;
+    bool eof = false;
+    char* decoded = NULL;
+    size_t decoded_capacity = 0;
+    
+    while (!eof) {
+        // 剩余空间不足一块时扩容（只有超长行或文档开头很长的front matter才会发生）
+        if (capacity - length < READ_CHUNK_SIZE) {
+            char* grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                fprintf(stderr, "内存分配失败\n");
+                exit(1);
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        
+        STATS_BEGIN(stats, read_timer, PHASE_READ);
+        size_t n = fread(buffer + length, 1, capacity - length, input);
+        STATS_END(stats, read_timer);
+        STATS_ADD(stats, bytes_read, n);
+        length += n;
+        eof = (n == 0);
+        
+        // 只处理完整的行，最后一段不完整的行留到下次；到达末尾时全部处理
+        const char* end = buffer + length;
+        if (!eof) {
+            while (end > buffer && end[-1] != '\n') end--;
+            if (end == buffer) continue;
+            // 开头的---或+++要读到结束行才能确定是否为front matter，在此之前整段保留；读到末尾仍未结束时按正文扫描
+            if (!renderer.started && front_matter_pending(buffer, end)) continue;
+        } else {
+            STATS_ADD(stats, lines_scanned, length > 0 && buffer[length - 1] != '\n');
+        }
+        
+        const char* feed = buffer;
+        const char* feed_end = end;
+        STATS_BEGIN(stats, decode_timer, PHASE_DECODE);
+        if (encoding == ENCODING_AUTO && find_non_ascii(buffer, end) != end) {
+            encoding = detect_encoding(buffer, (size_t)(end - buffer));
+        }
+        const uint32_t* table = encoding == ENCODING_GBK ? get_gbk_table() : NULL;
+        if (table != NULL) {
+            size_t size = (size_t)(end - buffer);
+            if (decoded_capacity < size + size / 2 + 4) {
+                decoded_capacity = size + size / 2 + 4;
+                free(decoded);
+                decoded = (char*)malloc(decoded_capacity);
+                if (decoded == NULL) {
+                    fprintf(stderr, "内存分配失败\n");
+                    exit(1);
+                }
+            }
+            feed = decoded;
+            feed_end = decoded + transcode_gbk(table, buffer, size, decoded, NULL);
+        }
+        STATS_END(stats, decode_timer);
+        fused_renderer_feed(&renderer, feed, feed_end, &line_number);
+        
+        size_t consumed = (size_t)(end - buffer);
+        memmove(buffer, end, length - consumed);
+        length -= consumed;
+        
+        // 每处理完一块就把已结束的子树写出
+        if (out.length > 0) {
+            output_flush(&out);
+            fflush(output);
+        }
+    }
+    
+    int status = ferror(input) ? 1 : 0;
+    if (status != 0) {
+        fprintf(stderr, "Error: Failed to read input\n");
+    }
+    
+    if (!fused_renderer_finish(&renderer)) status = 1;
+    
+    output_flush(&out);
+    fflush(output);
+    output_free(&out);
+    free_flat_mind_map(&section);
+    free(buffer);
+    free(decoded);
+    STATS_ADD(stats, lines_scanned, line_number - 1);
+    STATS_END(stats, timer);
+    return status;
+}
+
+// 递归版本的print_tree，仅用于与迭代版本做性能对比
+void print_tree_recursive(HeadingNode* node, int depth, bool is_last, OutputBuffer* prefix, OutputBuffer* output) {
+    size_t prefix_length = prefix->length;
     
-    while (1) {
-        printf("Enter Markdown filename (e.g., document.md or full path): ");
-        if (fgets(filename, MAX_FILENAME, stdin) != NULL) {
-            trim_whitespace(filename);
-            if (strlen(filename) > 0) {
-                break;
-            }
+    output_write(output, prefix->data, prefix->length);
+    if (depth > 0) {
+        output_puts(output, is_last ? "└── " : "├── ");
+    }
+    output_puts(output, get_icon(node->level));
+    output_write(output, " ", 1);
+    output_puts(output, node->text);
+    output_write(output, "\n", 1);
+    
+    output_puts(prefix, is_last ? "    " : "│   ");
+    for (HeadingNode* child = node->first_child; child != NULL; child = child->next_sibling) {
+        print_tree_recursive(child, depth + 1, child->next_sibling == NULL, prefix, output);
+    }
+    prefix->length = prefix_length;
+}
+
+// 生成性能测试用的文档 - 级别在1-6之间随机游走，每次最多加深一级，得到常见的文档形状
+char* generate_benchmark_document(int count, size_t* size) {
+    size_t capacity = (size_t)count * 48 + 64;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    size_t length = 0;
+    unsigned int seed = 12345;
+    int level = 1;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int step = (int)((seed >> 16) % 4);
+        level = step == 0 ? level + 1 : level - step + 1;
+        if (level < 1) level = 1;
+        if (level > MAX_LEVEL) level = MAX_LEVEL;
+        length += (size_t)snprintf(data + length, capacity - length, "%.*s Heading %d\ntext\n", level, "######", i);
+    }
+    
+    *size = length;
+    return data;
+}
+
+// 遍历性能测试 - 生成普通层次结构的文档，对比递归与迭代print_tree的渲染耗时
+void run_traversal_benchmark(int count) {
+    size_t size;
+    char* data = generate_benchmark_document(count, &size);
+    
+    ParserContext* ctx = create_parser_context();
+    parse_markdown_buffer(ctx, data, size, MAX_LEVEL);
+    HeadingNode* root = ctx->root;
+    
+    OutputBuffer prefix, output;
+    output_init(&prefix, NULL);
+    output_init(&output, NULL);
+    
+    double best_recursive = 0, best_iterative = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        output.length = 0;
+        double start = now_seconds();
+        for (HeadingNode* child = root->first_child; child != NULL; child = child->next_sibling) {
+            print_tree_recursive(child, 0, child->next_sibling == NULL, &prefix, &output);
         }
-        printf("Error: Filename cannot be empty, please re-enter!\n");
+        double elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < best_recursive) best_recursive = elapsed;
+        
+        output.length = 0;
+        start = now_seconds();
+        for (HeadingNode* child = root->first_child; child != NULL; child = child->next_sibling) {
+            print_tree(child, 0, child->next_sibling == NULL, &prefix, &output);
+        }
+        elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < best_iterative) best_iterative = elapsed;
     }
     
-    char level_input[10];
-    while (1) {
-        printf("Enter maximum heading level (1-%d, default 6): ", MAX_LEVEL);
-        if (fgets(level_input, sizeof(level_input), stdin) != NULL) {
-            trim_whitespace(level_input);
-            if (strlen(level_input) == 0) {
-                *max_level = MAX_LEVEL;
-                break;
+    double start = now_seconds();
+    free_tree(ctx);
+    double free_elapsed = now_seconds() - start;
+    
+    printf("Traversal benchmark: %d headings, %zu output bytes, best of %d rounds\n", count, output.length, BENCH_ROUNDS);
+    printf("%-24s %12s %12s\n", "Traversal", "Time(ms)", "ns/heading");
+    printf("%-24s %12.2f %12.1f\n", "print_tree (recursive)", best_recursive * 1e3, best_recursive * 1e9 / count);
+    printf("%-24s %12.2f %12.1f\n", "print_tree (iterative)", best_iterative * 1e3, best_iterative * 1e9 / count);
+    printf("%-24s %12.2f %12.1f\n", "free_tree (arena reset)", free_elapsed * 1e3, free_elapsed * 1e9 / count);
+    
+    output_free(&prefix);
+    output_free(&output);
+    free_parser_context(ctx);
+    free(data);
+}
+
+// 导出性能测试 - 解析与三种文本类输出的耗时和吞吐量对比，取多轮最好成绩
+void run_export_benchmark(int count) {
+    size_t size;
+    char* data = generate_benchmark_document(count, &size);
+    
+    ParserContext* ctx = create_parser_context();
+    OutputBuffer output;
+    output_init(&output, NULL);
+    
+    const char* names[4] = { "Parse", "Text tree", "JSON", "OPML" };
+    double best[4] = { 0, 0, 0, 0 };
+    size_t bytes[4] = { size, 0, 0, 0 };
+    
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now_seconds();
+        parse_markdown_buffer(ctx, data, size, MAX_LEVEL);
+        double elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < best[0]) best[0] = elapsed;
+        
+        for (int i = 1; i < 4; i++) {
+            output.length = 0;
+            start = now_seconds();
+            if (i == 1) render_mind_map(ctx, &output);
+            else if (i == 2) render_mind_map_json(ctx, &output);
+            else render_mind_map_opml(ctx, &output);
+            elapsed = now_seconds() - start;
+            if (round == 0 || elapsed < best[i]) best[i] = elapsed;
+            bytes[i] = output.length;
+        }
+    }
+    
+    printf("Export benchmark: %d headings, best of %d rounds\n", count, BENCH_ROUNDS);
+    printf("%-12s %12s %12s %12s %12s\n", "Stage", "Time(ms)", "ns/heading", "Bytes", "MB/s");
+    for (int i = 0; i < 4; i++) {
+        printf("%-12s %12.2f %12.1f %12zu %12.1f\n", names[i], best[i] * 1e3, best[i] * 1e9 / count,
+               bytes[i], bytes[i] / (1024.0 * 1024.0) / best[i]);
+    }
+    
+    output_free(&output);
+    free_parser_context(ctx);
+    free(data);
+}
+
+// 融合解析渲染性能测试 - 对比建树后渲染与融合渲染的耗时和保留的标题数，并检查输出一致
+void run_fused_benchmark(int count) {
+    size_t size;
+    char* data = generate_benchmark_document(count, &size);
+    
+    ParserContext* ctx = create_parser_context();
+    OutputBuffer tree_output, fused_output;
+    output_init(&tree_output, NULL);
+    output_init(&fused_output, NULL);
+    
+    double best_tree = 0, best_fused = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        tree_output.length = 0;
+        double start = now_seconds();
+        parse_markdown_buffer(ctx, data, size, MAX_LEVEL);
+        render_mind_map(ctx, &tree_output);
+        free_tree(ctx);
+        double elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < best_tree) best_tree = elapsed;
+        
+        fused_output.length = 0;
+        start = now_seconds();
+        render_markdown_fused(ctx, data, size, MAX_LEVEL, &fused_output);
+        elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < best_fused) best_fused = elapsed;
+    }
+    
+    bool same = tree_output.length == fused_output.length &&
+                memcmp(tree_output.data, fused_output.data, tree_output.length) == 0;
+    
+    // 单独再做一次不计时的融合渲染，统计同时保留的最多标题数
+    FusedRenderer renderer;
+    int line_number = 1;
+    fused_output.length = 0;
+    fused_renderer_init(&renderer, &ctx->section, MAX_LEVEL, &fused_output, &ctx->stats);
+    fused_renderer_feed(&renderer, data, data + size, &line_number);
+    int kept = renderer.peak_count;
+    fused_renderer_finish(&renderer);
+    
+    printf("Fused benchmark: %d headings, %zu output bytes, best of %d rounds\n", count, tree_output.length, BENCH_ROUNDS);
+    printf("%-24s %12s %12s %16s\n", "Mode", "Time(ms)", "ns/heading", "Kept headings");
+    printf("%-24s %12.2f %12.1f %16d\n", "Parse tree + render", best_tree * 1e3, best_tree * 1e9 / count, count);
+    printf("%-24s %12.2f %12.1f %16d\n", "Fused parse-render", best_fused * 1e3, best_fused * 1e9 / count, kept);
+    printf("%-24s %12s\n", "Output identical", same ? "yes" : "NO");
+    
+    output_free(&tree_output);
+    output_free(&fused_output);
+    free_parser_context(ctx);
+    free(data);
+}
+
+// 生成代码较多的测试文档 - 开头有YAML front matter，每节一个标题，后跟正文、带#注释的围栏代码块和缩进代码块
+// headings返回真正的标题数，front matter和代码块中的#行都不计入
+char* generate_code_heavy_document(int sections, size_t* size, int* headings) {
+    static const char* const body =
+        "Some prose describing the commands below.\n"
+        "```bash\n"
+        "# install dependencies\n"
+        "pip install -r requirements.txt\n"
+        "# run the tests\n"
+        "make -j8 test\n"
+        "```\n"
+        "    # indented code is not a heading either\n"
+        "    ./configure --prefix=/usr\n"
+        "~~~~python\n"
+        "# a comment\n"
+        "```\n"
+        "def main():\n"
+        "    return 0\n"
+        "~~~~\n";
+    size_t body_length = strlen(body);
+    size_t capacity = (size_t)sections * (body_length + 32) + 128;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
+    
+    size_t length = (size_t)snprintf(data, capacity, "---\n# generated benchmark document\ntitle: Bench\n---\n");
+    for (int i = 0; i < sections; i++) {
+        length += (size_t)snprintf(data + length, capacity - length, "%.*s Section %d\n", i % 3 + 1, "###", i);
+        memcpy(data + length, body, body_length);
+        length += body_length;
+    }
+    
+    *size = length;
+    *headings = sections;
+    return data;
+}
+
+// 扫描性能测试 - 在代码较多的文档上对比只找#行的旧扫描方式与跟踪块状态的扫描，并以memchr遍历全文作为内存带宽参考
+void run_scanner_benchmark(int sections) {
+    size_t size;
+    int expected;
+    char* data = generate_code_heavy_document(sections, &size, &expected);
+    const char* end = data + size;
+    
+    double best[3] = { 0, 0, 0 };
+    int found[3] = { 0, 0, 0 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int mode = 0; mode < 3; mode++) {
+            int count = 0;
+            int line_number = 1;
+            const char* ptr = data;
+            int level;
+            const char* title;
+            size_t title_length;
+            double start = now_seconds();
+            
+            if (mode == 0) {
+                count = memchr(data, '\0', size) == NULL ? 0 : -1;
+            } else if (mode == 1) {
+                while ((ptr = find_hash_line(ptr, end, &line_number)) < end) {
+                    const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+                    const char* line_end = newline ? newline : end;
+                    if (is_atx_heading(ptr, (size_t)(line_end - ptr), &level, &title, &title_length)) count++;
+                    if (newline == NULL) break;
+                    ptr = newline + 1;
+                    line_number++;
+                }
+            } else {
+                BlockState block;
+                ptr = begin_block_scan(&block, ptr, end, &line_number);
+                ptr = skip_front_matter(&block, ptr, end, &line_number);
+                while ((ptr = find_heading_candidate(&block, ptr, end, &line_number)) < end) {
+                    const char* newline = (const char*)memchr(ptr, '\n', (size_t)(end - ptr));
+                    const char* line_end = newline ? newline : end;
+                    if (scan_block_line(&block, ptr, (size_t)(line_end - ptr), &level, &title, &title_length)) count++;
+                    if (newline == NULL) break;
+                    ptr = newline + 1;
+                    line_number++;
+                }
             }
             
-            *max_level = atoi(level_input);
-            if (*max_level >= 1 && *max_level <= MAX_LEVEL) {
-                break;
+            double elapsed = now_seconds() - start;
+            if (round == 0 || elapsed < best[mode]) best[mode] = elapsed;
+            found[mode] = count;
+        }
+    }
+    
+    printf("Scanner benchmark: %d sections, %.1f MB of code-heavy Markdown, best of %d rounds\n",
+           sections, size / (1024.0 * 1024.0), BENCH_ROUNDS);
+    printf("%-28s %12s %12s %12s\n", "Mode", "Time(ms)", "MB/s", "Headings");
+    printf("%-28s %12.2f %12.1f %12s\n", "memchr pass (bandwidth)", best[0] * 1e3, size / (1024.0 * 1024.0) / best[0], "-");
+    printf("%-28s %12.2f %12.1f %12d\n", "# lines only (old scanner)", best[1] * 1e3, size / (1024.0 * 1024.0) / best[1], found[1]);
+    printf("%-28s %12.2f %12.1f %12d\n", "Fence/front-matter aware", best[2] * 1e3, size / (1024.0 * 1024.0) / best[2], found[2]);
+    printf("%-28s %12d %12s\n", "Real headings", expected, found[2] == expected ? "match" : "MISMATCH");
+    
+    free(data);
+}
+
+// 并行解析性能测试 - 对比单线程与多线程分块解析（建树和融合渲染两种路径），并核对输出一致
+void run_parallel_benchmark(int count, int threads) {
+    size_t size;
+    char* data = generate_benchmark_document(count, &size);
+    
+    ParserContext* ctx = create_parser_context();
+    OutputBuffer outputs[4];
+    double best[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        output_init(&outputs[i], NULL);
+    }
+    
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int mode = 0; mode < 4; mode++) {
+            ctx->threads = mode % 2 == 0 ? 1 : threads;
+            outputs[mode].length = 0;
+            double start = now_seconds();
+            if (mode < 2) {
+                parse_markdown_parallel(ctx, data, size, MAX_LEVEL);
+                render_mind_map(ctx, &outputs[mode]);
+                free_tree(ctx);
+            } else {
+                render_markdown_fused(ctx, data, size, MAX_LEVEL, &outputs[mode]);
             }
+            double elapsed = now_seconds() - start;
+            if (round == 0 || elapsed < best[mode]) best[mode] = elapsed;
         }
-        printf("Error: Level must be between 1-%d, please re-enter!\n", MAX_LEVEL);
     }
     
-    printf("\n");
+    bool same = true;
+    for (int mode = 1; mode < 4; mode++) {
+        if (outputs[mode].length != outputs[0].length ||
+            memcmp(outputs[mode].data, outputs[0].data, outputs[0].length) != 0) {
+            same = false;
+        }
+    }
+    
+    printf("Parallel benchmark: %d headings, %.1f MB, %d threads (%d cores), best of %d rounds\n",
+           count, size / (1024.0 * 1024.0), threads, detect_cpu_count(), BENCH_ROUNDS);
+    if (size < 2 * (size_t)PARALLEL_CHUNK_MIN) {
+        printf("Input is below %d MB, parallel modes fall back to a single thread\n", 2 * PARALLEL_CHUNK_MIN / (1024 * 1024));
+    }
+    const char* names[4] = { "Parse + render, 1 thread", "Parse + render, parallel", "Fused, 1 thread", "Fused, parallel" };
+    printf("%-26s %12s %12s %10s\n", "Mode", "Time(ms)", "MB/s", "Speedup");
+    for (int mode = 0; mode < 4; mode++) {
+        double baseline = best[mode - mode % 2];
+        printf("%-26s %12.2f %12.1f %9.2fx\n", names[mode], best[mode] * 1e3,
+               size / (1024.0 * 1024.0) / best[mode], baseline / best[mode]);
+    }
+    printf("%-26s %12s\n", "Output identical", same ? "yes" : "NO");
+    
+    for (int i = 0; i < 4; i++) {
+        output_free(&outputs[i]);
+    }
+    free_parser_context(ctx);
+    free(data);
 }
 
-// 显示主菜单
-void show_main_menu() {
-    clear_screen();
-    printf("==========================================\n");
-    printf("      Markdown Mind Map Generator\n");
-    printf("==========================================\n");
-    printf("         Total Operations: %d\n", total_operations);
-    printf("==========================================\n\n");
+// 增量解析性能测试 - 生成指定大小的文档，对比完整解析与修改一行后增量解析的耗时
+void run_incremental_benchmark(int megabytes) {
+    size_t target = (size_t)megabytes * 1024 * 1024;
+    const char* inserted = "## Inserted heading\n";
+    size_t capacity = target + 256;
+    char* data = (char*)malloc(capacity);
+    char* edited = (char*)malloc(capacity + strlen(inserted));
+    if (data == NULL || edited == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
     
-    printf("1. Process Markdown File\n");
-    printf("2. View Operation History\n");
-    printf("3. Clear Screen\n");
-    printf("4. Exit\n\n");
+    // 每个标题后跟若干行正文，级别在1-4之间循环
+    size_t size = 0;
+    int heading = 0;
+    while (size + 160 < target) {
+        size += (size_t)snprintf(data + size, capacity - size, "%.*s Heading %d\n", heading % 4 + 1, "####", heading);
+        heading++;
+        for (int i = 0; i < 8 && size + 160 < target; i++) {
+            size += (size_t)snprintf(data + size, capacity - size, "Body text line %d of a benchmark document.\n", i);
+        }
+    }
     
-    printf("Please select an option (1-4): ");
+    // 在文档中间插入一个标题
+    const char* middle = (const char*)memchr(data + size / 2, '\n', size - size / 2) + 1;
+    int middle_line = 1;
+    for (const char* ptr = data; ptr < middle; ptr++) {
+        if (*ptr == '\n') middle_line++;
+    }
+    size_t head = (size_t)(middle - data);
+    memcpy(edited, data, head);
+    memcpy(edited + head, inserted, strlen(inserted));
+    memcpy(edited + head + strlen(inserted), middle, size - head);
+    size_t edited_size = size + strlen(inserted);
+    
+    ParserContext* check = create_parser_context();
+    ParserContext* ranged = create_parser_context();
+    
+    double start = now_seconds();
+    parse_markdown_buffer(check, edited, edited_size, MAX_LEVEL);
+    double full_elapsed = now_seconds() - start;
+    
+    parse_markdown_buffer(ranged, data, size, MAX_LEVEL);
+    start = now_seconds();
+    bool spliced = parse_markdown_edit(ranged, edited, edited_size, middle_line, 0, 1);
+    double edit_elapsed = now_seconds() - start;
+    
+    // 增量结果必须与完整解析一致
+    OutputBuffer expected, actual;
+    output_init(&expected, NULL);
+    output_init(&actual, NULL);
+    render_mind_map(check, &expected);
+    render_mind_map(ranged, &actual);
+    bool same = spliced && actual.length == expected.length && memcmp(actual.data, expected.data, actual.length) == 0 &&
+                ranged->headings.count == check->headings.count;
+    for (int i = 0; same && i < check->headings.count; i++) {
+        same = ranged->headings.items[i]->line_number == check->headings.items[i]->line_number;
+    }
+    
+    printf("Incremental benchmark: %.1f MB, %d headings, one heading inserted in the middle\n",
+           edited_size / (1024.0 * 1024.0), check->headings.count);
+    printf("%-28s %12s %12s\n", "Mode", "Time(ms)", "Identical");
+    printf("%-28s %12.2f %12s\n", "Full parse", full_elapsed * 1e3, "-");
+    printf("%-28s %12.2f %12s\n", "Incremental (edit range)", edit_elapsed * 1e3, same ? "yes" : "NO");
+    
+    output_free(&expected);
+    output_free(&actual);
+    free_parser_context(check);
+    free_parser_context(ranged);
+    free(data);
+    free(edited);
 }
 
-// 处理单个文件
-void process_single_file() {
-    char filename[MAX_FILENAME];
-    char output_filename[MAX_FILENAME];
-    int max_level;
+// 合成文档用的伪随机数，与generate_benchmark_document相同的线性同余序列
+unsigned int corpus_random(unsigned int* state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7FFF;
+}
+
+// 向buffer写入空格分隔的单词，直到长度不小于target，返回写入的字节数
+// 中文词按选项使用UTF-8或GBK编码，buffer至少要有target + 32字节
+size_t append_corpus_words(const CorpusOptions* options, unsigned int* state, char* buffer, size_t target) {
+    static const char* const words[] = {
+        "request", "limit", "server", "parse", "token", "cache", "index", "render",
+        "client", "header", "stream", "config", "deploy", "error", "retry", "batch"
+    };
+    static const char* const cjk_words[][2] = {
+        { "中文", "\xd6\xd0\xce\xc4" },
+        { "标题", "\xb1\xea\xcc\xe2" },
+        { "思维", "\xcb\xbc\xce\xac" },
+        { "导图", "\xb5\xbc\xcd\xbc" },
+        { "测试", "\xb2\xe2\xca\xd4" },
+        { "数据", "\xca\xfd\xbe\xdd" },
+        { "解析", "\xbd\xe2\xce\xf6" },
+        { "文档", "\xce\xc4\xb5\xb5" },
+        { "接口", "\xbd\xd3\xbf\xda" },
+        { "限流", "\xcf\xde\xc1\xf7" },
+        { "配置", "\xc5\xe4\xd6\xc3" },
+        { "部署", "\xb2\xbf\xca\xf0" }
+    };
     
-    clear_screen();
-    get_user_input(filename, &max_level);
+    size_t length = 0;
+    while (length < target) {
+        const char* word;
+        if ((int)(corpus_random(state) % 100) < options->cjk_percent) {
+            word = cjk_words[corpus_random(state) % 12][options->gbk ? 1 : 0];
+        } else {
+            word = words[corpus_random(state) % 16];
+        }
+        
+        if (length > 0) buffer[length++] = ' ';
+        size_t word_length = strlen(word);
+        memcpy(buffer + length, word, word_length);
+        length += word_length;
+    }
+    return length;
+}
+
+// 按参数生成合成Markdown文档 - 每行以概率heading_percent为标题，其余为长度在line_length的0.5到1.5倍之间的正文
+// 标题级别按depth分布变化，标题之后按fence_percent插入一段含#注释的围栏代码块；headings返回标题数
+char* generate_corpus(const CorpusOptions* options, size_t* size, int* headings) {
+    size_t capacity = options->size + CORPUS_MAX_LINE * 2;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        fprintf(stderr, "内存分配失败\n");
+        exit(1);
+    }
     
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error: Cannot open file %s\n", filename);
-        printf("Please check if the file exists or the path is correct.\n");
-        add_log_entry(filename, "Failed to open file");
-        printf("Press any key to continue...");
-        getchar();
-        return;
+    unsigned int state = options->seed;
+    size_t length = 0;
+    int level = 1;
+    int count = 0;
+    
+    while (length < options->size) {
+        if ((int)(corpus_random(&state) % 100) < options->heading_percent) {
+            int step = (int)(corpus_random(&state) % 10);
+            if (options->depth == DEPTH_FLAT) {
+                level = 1 + step % 2;
+            } else if (options->depth == DEPTH_BALANCED) {
+                level += step < 3 ? 1 : (step < 6 ? 0 : -1);
+            } else {
+                level = step < 7 ? level + 1 : 1 + (int)(corpus_random(&state) % (unsigned int)level);
+            }
+            if (level < 1) level = 1;
+            if (level > MAX_LEVEL) level = MAX_LEVEL;
+            
+            memset(data + length, '#', (size_t)level);
+            length += (size_t)level;
+            data[length++] = ' ';
+            length += append_corpus_words(options, &state, data + length, 12 + corpus_random(&state) % 24);
+            data[length++] = '\n';
+            count++;
+            
+            if ((int)(corpus_random(&state) % 100) < options->fence_percent) {
+                const char* fence = "```bash\n# install\nmake -j8 install\n# verify\nmake check\n```\n";
+                size_t fence_length = strlen(fence);
+                memcpy(data + length, fence, fence_length);
+                length += fence_length;
+            }
+        } else {
+            size_t target = (size_t)options->line_length / 2 + corpus_random(&state) % (unsigned int)(options->line_length + 1);
+            length += append_corpus_words(options, &state, data + length, target);
+            data[length++] = '\n';
+        }
     }
     
-    generate_output_filename(filename, output_filename);
+    *size = length;
+    *headings = count;
+    return data;
+}
+
+// 进程的内存峰值（KB），不支持时返回-1
+long peak_rss_kb() {
+    #ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        #ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+        #else
+        return usage.ru_maxrss;
+        #endif
+    }
+    #endif
+    return -1;
+}
+
+// 基准测试 - 生成合成文档写入临时文件，分别计时parse_markdown_file、add_to_tree、print_tree和free_tree，
+// 结果以一行JSON输出到标准输出，便于脚本比较不同版本
+// parse_markdown_file包含读入、扫描和建树；add_to_tree单独计时时把已解析的节点重新链接一遍；
+// print_tree经render_mind_map渲染到内存，不计写文件的时间
+int run_benchmark_harness(int argc, char* argv[]) {
+    CorpusOptions options;
+    options.size = (size_t)BENCH_DEFAULT_MEGABYTES * 1024 * 1024;
+    options.heading_percent = 10;
+    options.depth = DEPTH_BALANCED;
+    options.line_length = 80;
+    options.fence_percent = 10;
+    options.cjk_percent = 0;
+    options.gbk = false;
+    options.seed = 12345;
+    int rounds = BENCH_ROUNDS;
+    const char* save_path = NULL;
     
-    FILE* output_file = fopen(output_filename, "w");
-    if (output_file == NULL) {
-        printf("Error: Cannot create output file %s\n", output_filename);
-        fclose(file);
-        add_log_entry(filename, "Failed to create output file");
-        printf("Press any key to continue...");
-        getchar();
-        return;
+    for (int i = 2; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool valid = value != NULL;
+        
+        if (valid && strcmp(argv[i], "--size") == 0) {
+            int megabytes = atoi(value);
+            valid = megabytes >= 1;
+            options.size = (size_t)megabytes * 1024 * 1024;
+        } else if (valid && strcmp(argv[i], "--density") == 0) {
+            options.heading_percent = atoi(value);
+            valid = options.heading_percent >= 1 && options.heading_percent <= 100;
+        } else if (valid && strcmp(argv[i], "--depth") == 0) {
+            if (strcmp(value, "flat") == 0) options.depth = DEPTH_FLAT;
+            else if (strcmp(value, "balanced") == 0) options.depth = DEPTH_BALANCED;
+            else if (strcmp(value, "deep") == 0) options.depth = DEPTH_DEEP;
+            else valid = false;
+        } else if (valid && strcmp(argv[i], "--line-length") == 0) {
+            options.line_length = atoi(value);
+            valid = options.line_length >= 8 && options.line_length <= CORPUS_MAX_LINE / 2;
+        } else if (valid && strcmp(argv[i], "--fences") == 0) {
+            options.fence_percent = atoi(value);
+            valid = options.fence_percent >= 0 && options.fence_percent <= 100;
+        } else if (valid && strcmp(argv[i], "--cjk") == 0) {
+            options.cjk_percent = atoi(value);
+            valid = options.cjk_percent >= 0 && options.cjk_percent <= 100;
+        } else if (valid && strcmp(argv[i], "--encoding") == 0) {
+            if (strcmp(value, "utf8") == 0) options.gbk = false;
+            else if (strcmp(value, "gbk") == 0) options.gbk = true;
+            else valid = false;
+        } else if (valid && strcmp(argv[i], "--seed") == 0) {
+            options.seed = (unsigned int)strtoul(value, NULL, 10);
+        } else if (valid && strcmp(argv[i], "--rounds") == 0) {
+            rounds = atoi(value);
+            valid = rounds >= 1;
+        } else if (valid && strcmp(argv[i], "--save") == 0) {
+            save_path = value;
+        } else {
+            valid = false;
+        }
+        
+        if (!valid) {
+            printf("Error: Invalid benchmark option %s\n", argv[i]);
+            return 1;
+        }
+        i++;
     }
     
-    printf("Processing file: %s\n", filename);
-    printf("Extracting headings at level %d or below...\n", max_level);
-    printf("==========================================\n\n");
+    size_t size;
+    int headings;
+    char* data = generate_corpus(&options, &size, &headings);
     
-    parse_markdown_file(file, max_level);
+    // 保存到指定文件时也用这个文件计时，否则用临时文件
+    FILE* file = save_path != NULL ? fopen(save_path, "w+b") : tmpfile();
+    if (file == NULL || fwrite(data, 1, size, file) != size || fflush(file) != 0) {
+        printf("Error: Cannot write benchmark corpus\n");
+        if (file != NULL) fclose(file);
+        free(data);
+        return 1;
+    }
+    free(data);
     
-    printf("Mind Map Preview:\n");
-    printf("------------------------------------------\n");
-    print_mind_map(max_level, stdout);
-    printf("------------------------------------------\n\n");
+    ParserContext* ctx = create_parser_context();
+    OutputBuffer output;
+    output_init(&output, NULL);
+    HeadingNode** nodes = NULL;
+    int node_count = 0;
     
-    // 保存结果到文件
-    fprintf(output_file, "Markdown File: %s\n", filename);
-    fprintf(output_file, "Extraction Level: Level %d and below\n", max_level);
-    fprintf(output_file, "Generated: %s", __DATE__);
-    fprintf(output_file, " %s\n", __TIME__);
-    fprintf(output_file, "==========================================\n");
-    print_mind_map(max_level, output_file);
-    fprintf(output_file, "==========================================\n");
+    static const char* const phase_names[] = { "parse_markdown_file", "add_to_tree", "print_tree", "free_tree" };
+    double best[4] = { 0, 0, 0, 0 };
     
-    printf("Mind map saved to: %s\n\n", output_filename);
+    for (int round = 0; round < rounds; round++) {
+        double times[4];
+        
+        rewind(file);
+        double start = now_seconds();
+        parse_markdown_file(ctx, file, MAX_LEVEL);
+        times[0] = now_seconds() - start;
+        
+        // 清空所有链接后按文档顺序重新加入，只计add_to_tree本身
+        node_count = ctx->headings.count;
+        nodes = (HeadingNode**)realloc(nodes, (size_t)(node_count > 0 ? node_count : 1) * sizeof(HeadingNode*));
+        if (nodes == NULL) {
+            fprintf(stderr, "内存分配失败\n");
+            exit(1);
+        }
+        memcpy(nodes, ctx->headings.items, (size_t)node_count * sizeof(HeadingNode*));
+        for (int i = 0; i < node_count; i++) {
+            nodes[i]->parent = NULL;
+            nodes[i]->first_child = NULL;
+            nodes[i]->last_child = NULL;
+            nodes[i]->next_sibling = NULL;
+        }
+        ctx->root->first_child = NULL;
+        ctx->root->last_child = NULL;
+        ctx->headings.count = 0;
+        
+        start = now_seconds();
+        for (int i = 0; i < node_count; i++) {
+            add_to_tree(ctx, nodes[i]);
+        }
+        times[1] = now_seconds() - start;
+        
+        output.length = 0;
+        start = now_seconds();
+        render_mind_map(ctx, &output);
+        times[2] = now_seconds() - start;
+        
+        start = now_seconds();
+        free_tree(ctx);
+        times[3] = now_seconds() - start;
+        
+        for (int phase = 0; phase < 4; phase++) {
+            if (round == 0 || times[phase] < best[phase]) best[phase] = times[phase];
+        }
+    }
     
-    // 记录成功操作
-    char success_msg[256];
-    snprintf(success_msg, sizeof(success_msg), "Successfully processed, output: %s", output_filename);
-    add_log_entry(filename, success_msg);
+    static const char* const depth_names[] = { "flat", "balanced", "deep" };
+    double megabytes = size / (1024.0 * 1024.0);
+    printf("{\"benchmark\":\"mtmt\",\"corpus\":{\"bytes\":%zu,\"headings\":%d,\"density\":%d,\"depth\":\"%s\","
+           "\"line_length\":%d,\"fences\":%d,\"cjk\":%d,\"encoding\":\"%s\",\"seed\":%u},\"rounds\":%d,\"phases\":[",
+           size, headings, options.heading_percent, depth_names[options.depth], options.line_length,
+           options.fence_percent, options.cjk_percent, options.gbk ? "gbk" : "utf8", options.seed, rounds);
+    for (int phase = 0; phase < 4; phase++) {
+        double seconds = best[phase] > 0 ? best[phase] : 1e-9;
+        printf("%s{\"name\":\"%s\",\"ms\":%.3f,\"mb_per_s\":%.1f,\"headings_per_s\":%.0f}", phase > 0 ? "," : "",
+               phase_names[phase], best[phase] * 1e3, megabytes / seconds, node_count / seconds);
+    }
+    printf("],\"nodes\":%d,\"output_bytes\":%zu,\"peak_rss_kb\":%ld}\n", node_count, output.length, peak_rss_kb());
     
-    // 清理资源
+    free(nodes);
+    output_free(&output);
+    free_parser_context(ctx);
     fclose(file);
-    fclose(output_file);
-    free_tree(root);
-    root = NULL;
+    return 0;
+}
+
+// 命令行模式
+int run_command_line(int argc, char* argv[]) {
+    if (strcmp(argv[1], "--batch") == 0) {
+        return run_batch(argc, argv);
+    }
     
-    printf("Press any key to continue...");
-    getchar();
-    getchar(); // 获取回车键
+    if (strcmp(argv[1], "--stdin") == 0) {
+        int max_level = MAX_LEVEL;
+        TextEncoding encoding = ENCODING_AUTO;
+        ConversionStats stats;
+        stats.enabled = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+                max_level = atoi(argv[++i]);
+                if (max_level < 1 || max_level > MAX_LEVEL) {
+                    printf("Error: Level must be between 1-%d\n", MAX_LEVEL);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+                if (!parse_encoding_name(argv[++i], &encoding)) {
+                    printf("Error: Unknown encoding %s (use auto, utf8 or gbk)\n", argv[i]);
+                    return 1;
+                }
+            } else if (parse_stats_flag(argv[i])) {
+                stats.enabled = true;
+            }
+        }
+        stats_reset(&stats);
+        
+        // 统计记录写到stderr，不混入思维导图输出
+        int status = stream_markdown(stdin, stdout, max_level, encoding, &stats);
+        if (stats.enabled) {
+            OutputBuffer json;
+            output_init(&json, stderr);
+            render_stats_json(&stats, NULL, max_level, &json);
+            output_puts(&json, "\n");
+            output_flush(&json);
+            output_free(&json);
+        }
+        return status;
+    }
+    
+    if (strcmp(argv[1], "--daemon") == 0 || strcmp(argv[1], "--request") == 0) {
+        #ifndef _WIN32
+        return strcmp(argv[1], "--daemon") == 0 ? run_daemon(argc, argv) : run_daemon_request(argc, argv);
+        #else
+        printf("Error: %s requires Unix domain sockets and is not available on Windows\n", argv[1]);
+        return 1;
+        #endif
+    }
+    
+    if (strcmp(argv[1], "--watch") == 0) {
+        #ifdef __linux__
+        return run_watch(argc, argv);
+        #else
+        printf("Error: --watch requires inotify and is only available on Linux\n");
+        return 1;
+        #endif
+    }
+    
+    if (strcmp(argv[1], "--show") == 0 && argc >= 3) {
+        return show_binary_mind_map(argv[2]);
+    }
+    
+    if (strcmp(argv[1], "--index-build") == 0) {
+        return run_index_build(argc, argv);
+    }
+    
+    if (strcmp(argv[1], "--query") == 0) {
+        return run_query(argc, argv);
+    }
+    
+    if (strcmp(argv[1], "--bench") == 0) {
+        return run_benchmark_harness(argc, argv);
+    }
+    
+    if (strcmp(argv[1], "--bench-siblings") == 0) {
+        int count = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_SIBLINGS;
+        if (count < 1) {
+            printf("Error: Sibling count must be positive\n");
+            return 1;
+        }
+        run_sibling_benchmark(count);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-traversal") == 0) {
+        int count = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_HEADINGS;
+        if (count < 1) {
+            printf("Error: Heading count must be positive\n");
+            return 1;
+        }
+        run_traversal_benchmark(count);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-export") == 0) {
+        int count = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_HEADINGS;
+        if (count < 1) {
+            printf("Error: Heading count must be positive\n");
+            return 1;
+        }
+        run_export_benchmark(count);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-fused") == 0) {
+        int count = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_HEADINGS;
+        if (count < 1) {
+            printf("Error: Heading count must be positive\n");
+            return 1;
+        }
+        run_fused_benchmark(count);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-scanner") == 0) {
+        int sections = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_SECTIONS;
+        if (sections < 1) {
+            printf("Error: Section count must be positive\n");
+            return 1;
+        }
+        run_scanner_benchmark(sections);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-parallel") == 0) {
+        int count = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_HEADINGS;
+        int threads = argc >= 4 ? atoi(argv[3]) : detect_cpu_count();
+        if (count < 1 || threads < 1) {
+            printf("Error: Heading count and thread count must be positive\n");
+            return 1;
+        }
+        run_parallel_benchmark(count, threads);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "--bench-incremental") == 0) {
+        int megabytes = argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_MEGABYTES;
+        if (megabytes < 1) {
+            printf("Error: Size must be positive\n");
+            return 1;
+        }
+        run_incremental_benchmark(megabytes);
+        return 0;
+    }
+    
+    printf("Usage: %s [--stats]                (interactive menu)\n", argv[0]);
+    printf("       %s --batch [--level N] [--jobs N] [--cache DIR] [--format txt|bin|json|opml] [--encoding auto|utf8|gbk]\n", argv[0]);
+    printf("              [--stats] <dir|file|glob>...\n");
+    printf("       %s --stdin [--level N] [--encoding auto|utf8|gbk] [--stats] (stream Markdown from stdin to stdout)\n", argv[0]);
+    printf("       %s --watch [--level N] [--jobs N] [--format txt|bin|json|opml] [--debounce MS] <dir>...\n", argv[0]);
+    printf("              (keep mind maps up to date while files change)\n");
+    printf("       %s --show <file.mtmb>       (print a binary mind map as text)\n", argv[0]);
+    printf("       %s --index-build <index> [--level N] [--jobs N] [--encoding auto|utf8|gbk] <dir|file|glob>...\n", argv[0]);
+    printf("              (collect every heading into a searchable index)\n");
+    printf("       %s --query <index> [--prefix] [--limit N] <text> (find headings by substring or prefix, ignoring case)\n", argv[0]);
+    printf("       %s --daemon [--jobs N] <socket> (serve conversion requests on a Unix socket)\n", argv[0]);
+    printf("       %s --request <socket> [--level N] [--format txt|bin|json|opml] <file> (convert through the daemon)\n", argv[0]);
+    printf("       %s --bench [--size MB] [--density %%] [--depth flat|balanced|deep] [--line-length N] [--fences %%]\n", argv[0]);
+    printf("              [--cjk %%] [--encoding utf8|gbk] [--seed N] [--rounds N] [--save FILE]  (JSON phase timings)\n");
+    printf("       %s --bench-siblings [count] (tree construction benchmark, default %d)\n", argv[0], BENCH_DEFAULT_SIBLINGS);
+    printf("       %s --bench-traversal [count] (recursive vs iterative rendering, default %d)\n", argv[0], BENCH_DEFAULT_HEADINGS);
+    printf("       %s --bench-export [count]   (text, JSON and OPML export vs parse, default %d)\n", argv[0], BENCH_DEFAULT_HEADINGS);
+    printf("       %s --bench-fused [count]    (tree vs fused parse-and-render, default %d)\n", argv[0], BENCH_DEFAULT_HEADINGS);
+    printf("       %s --bench-scanner [sections] (plain vs fence-aware heading scan, default %d)\n", argv[0], BENCH_DEFAULT_SECTIONS);
+    printf("       %s --bench-parallel [count] [threads] (single vs multi-threaded parsing, default %d)\n", argv[0], BENCH_DEFAULT_HEADINGS);
+    printf("       %s --bench-incremental [MB] (full vs incremental re-parse, default %d)\n", argv[0], BENCH_DEFAULT_MEGABYTES);
+    return 1;
 }
 
 // 主函数
-int main() {
+int main(int argc, char* argv[]) {
+    bool stats = argc == 2 && parse_stats_flag(argv[1]);
+    if (argc > 1 && !stats) {
+        return run_command_line(argc, argv);
+    }
+    
     // 设置控制台输出编码（Windows）
     #ifdef _WIN32
     system("chcp 65001 >nul");
     #endif
     
     char choice[10];
+    ParserContext* ctx = create_parser_context();
+    ctx->threads = detect_cpu_count();
+    ctx->stats.enabled = stats;
+    OperationLog log = { NULL, 0 };
     
     while (1) {
-        show_main_menu();
+        show_main_menu(&log);
         
         if (fgets(choice, sizeof(choice), stdin) != NULL) {
             trim_whitespace(choice);
             
             if (strcmp(choice, "1") == 0) {
-                process_single_file();
+                process_single_file(ctx, &log);
             }
             else if (strcmp(choice, "2") == 0) {
-                show_log_history();
+                show_log_history(&log);
             }
             else if (strcmp(choice, "3") == 0) {
                 clear_screen();
             }
             else if (strcmp(choice, "4") == 0) {
                 printf("\nThank you for using Markdown Mind Map Generator!\n");
-                printf("Total operations performed: %d\n", total_operations);
+                printf("Total operations performed: %d\n", log.total_operations);
                 break;
             }
             else {
@@ -585,10 +7839,8 @@ int main() {
     }
     
     // 程序结束前释放所有内存
-    free_logs();
-    if (root != NULL) {
-        free_tree(root);
-    }
+    free_logs(&log);
+    free_parser_context(ctx);
     
     return 0;
 }
\ No newline at end of file